@@ -1,22 +1,61 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <sys/time.h>
 #include "ai.h"
 #include "minmax.h"
+#include "expectimax.h"
+#include "evaluator.h"
+#include "../models/calculator.h"
+
+/* half width of the first window around the last iteration's value */
+#define AI_ASPIRATION   EVALUATOR_ONE
+
+/*
+ * Boards other than 4x4 are searched by a small expectimax over
+ * board_move: AI_BOARD_DEPTH moves deep, spawns on AI_BOARD_SAMPLE
+ * empty cells spread over the board, leaves valued by their empty cells.
+ */
+#define AI_BOARD_DEPTH  3
+#define AI_BOARD_SAMPLE 6
+
+#define MIN(a, b)   (((a) <= (b)) ? (a) : (b))
+#define MAX(a, b)   (((a) >= (b)) ? (a) : (b))
 
 typedef struct _ai
 {
   uint32            count;
   minmax            *engine;
+  expectimax        *expect;
+  enum ai_engine    kind;             /* which search plays */
+  calculator        *calc;
   uint32            thinking_duration;
   enum direction    last_dir;
+  uint64            visited;          /* search nodes of this ai_get */
+  uint64            pruned;
+  uint64            table_hits;       /* and its transposition table use */
+  uint64            table_misses;
+  uint64            table_collisions;
+  board             *moved[AI_BOARD_DEPTH];       /* search boards, */
+  board             *spawned[AI_BOARD_DEPTH - 1]; /* shaped as last game */
 } ai;
 
 static ai *a = NULL;
 
+static enum direction ai_search(ai *self, bitboard bits, uint32 depth,
+  int32 *value, bool aspiration);
+static bool ai_shape_boards(ai *self, board *b);
+static void ai_free_boards(ai *self);
+static enum direction ai_get_board(ai *self, board *b);
+static int32 ai_board_player(ai *self, board *b, uint32 depth,
+  enum direction *best);
+static int32 ai_board_chance(ai *self, board *b, uint32 depth);
+static enum direction ai_get_greedy(ai *self, board *b);
+
 bool ai_create(ai **self)
 {
   bool ret = false;
+  uint32 i = 0;
 
   if (a != NULL)
   {
@@ -30,9 +69,25 @@ bool ai_create(ai **self)
     if (a != NULL)
     {
       minmax_create(&a->engine);
+      expectimax_create(&a->expect);
+      calculator_create(&a->calc);
+      a->kind = AI_ENGINE_MINMAX;
       a->count = 1;
       a->thinking_duration = 0;
       a->last_dir = BOTTOM_OF_DIRECTION;
+      a->visited = 0;
+      a->pruned = 0;
+      a->table_hits = 0;
+      a->table_misses = 0;
+      a->table_collisions = 0;
+      for (i = 0; i < AI_BOARD_DEPTH; i++)
+      {
+        a->moved[i] = NULL;
+      }
+      for (i = 0; i < AI_BOARD_DEPTH - 1; i++)
+      {
+        a->spawned[i] = NULL;
+      }
       *self = a;
       ret = true;
     }
@@ -50,6 +105,9 @@ void ai_destory(ai **self)
     if (a->count == 0)
     {
       minmax_destory(&a->engine);
+      expectimax_destory(&a->expect);
+      calculator_destory(&a->calc);
+      ai_free_boards(a);
       free(a);
       a = NULL;
     }
@@ -64,21 +122,96 @@ void ai_set_thinking_duration(ai *self, uint32 duration)
   }
 }
 
+bool ai_load_weights(ai *self, const char *path)
+{
+  bool ret = false;
+
+  if (self != NULL)
+  {
+    ret = minmax_load_weights(self->engine, path);
+    ret &= expectimax_load_weights(self->expect, path);
+  }
+
+  return ret;
+}
+
+void ai_set_weights(ai *self, float smoothness, float monotonicity,
+  float empty, float max_value)
+{
+  if (self != NULL)
+  {
+    minmax_set_weights(self->engine, smoothness, monotonicity, empty,
+      max_value);
+    expectimax_set_weights(self->expect, smoothness, monotonicity, empty,
+      max_value);
+  }
+}
+
+bool ai_set_table_size(ai *self, uint32 megabytes)
+{
+  bool ret = false;
+
+  if (self != NULL)
+  {
+    ret = minmax_set_table_size(self->engine, megabytes);
+    ret &= expectimax_set_table_size(self->expect, megabytes);
+  }
+
+  return ret;
+}
+
+bool ai_set_engine(ai *self, enum ai_engine engine)
+{
+  bool ret = false;
+
+  if (self != NULL && engine < BOTTOM_OF_AI_ENGINE)
+  {
+    self->kind = engine;
+    switch (engine)
+    {
+      case AI_ENGINE_MINMAX_TREE:
+        ret = minmax_set_mode(self->engine, MINMAX_MODE_TREE);
+        break;
+      case AI_ENGINE_BEST_FIRST:
+        ret = minmax_set_mode(self->engine, MINMAX_MODE_BEST_FIRST);
+        break;
+      default:
+        ret = minmax_set_mode(self->engine, MINMAX_MODE_DEPTH_FIRST);
+        break;
+    }
+  }
+
+  return ret;
+}
+
 enum direction ai_get(ai *self, board *b)
 {
   enum direction best = BOTTOM_OF_DIRECTION;
-  uint32 depth = 3;
+  uint32 depth = 3, searched = 0;
+  int32 value = 0;
   struct timeval now;
   uint64 start = 0, end = 0;
+  bitboard bits = board_get_bitboard(b);
 
-  if (self != NULL)
+  if (self != NULL && board_is_bitboard(b) == false)
   {
+    best = ai_get_board(self, b);
+    self->last_dir = best;
+  }
+  else if (self != NULL)
+  {
+    self->visited = 0;
+    self->pruned = 0;
+    self->table_hits = 0;
+    self->table_misses = 0;
+    self->table_collisions = 0;
     if (self->thinking_duration > 0)
     {
       gettimeofday(&now, NULL);
       start = now.tv_sec * 1000 + now.tv_usec / 1000;
       do {
-        best = minmax_search(self->engine, b, self->last_dir, depth);
+        best = ai_search(self, bits, depth, &value, searched != 0);
+        searched = depth;
         if (best == BOTTOM_OF_DIRECTION)
         {
           break;
@@ -94,10 +227,242 @@ enum direction ai_get(ai *self, board *b)
     }
     else
     {
-      best = minmax_search(self->engine, b, self->last_dir, MAX_SEARCH_DEPTH);
+      best = ai_search(self, bits, MAX_SEARCH_DEPTH, &value, false);
+      searched = MAX_SEARCH_DEPTH;
     }
+    LOG("search: depth %u, %llu nodes, %llu pruned", searched,
+      (unsigned long long)self->visited, (unsigned long long)self->pruned);
+    LOG("table: %llu hits, %llu misses, %llu collisions",
+      (unsigned long long)self->table_hits,
+      (unsigned long long)self->table_misses,
+      (unsigned long long)self->table_collisions);
     self->last_dir = best;
   }
 
   return best;
 }
+
+/*
+ * One iteration of the deepening.  With aspiration the window starts
+ * narrow around *value, the previous iteration's result, and widens on
+ * whichever side the value falls out of until it lands inside.
+ * Expectimax has no window to narrow, and best first grows on from the
+ * last iteration instead of searching again.
+ */
+static enum direction ai_search(ai *self, bitboard bits, uint32 depth,
+  int32 *value, bool aspiration)
+{
+  enum direction best = BOTTOM_OF_DIRECTION;
+  int64 alpha = INT32_MIN, beta = INT32_MAX, delta = AI_ASPIRATION;
+  uint64 visited = 0, pruned = 0, hits = 0, misses = 0, collisions = 0;
+  int32 result = 0;
+
+  if (self->kind == AI_ENGINE_EXPECTIMAX)
+  {
+    best = expectimax_search(self->expect, bits, depth);
+    expectimax_get_stats(self->expect, &visited, &pruned);
+    expectimax_get_table_stats(self->expect, &hits, &misses, &collisions);
+    self->visited += visited;
+    self->pruned += pruned;
+    self->table_hits += hits;
+    self->table_misses += misses;
+    self->table_collisions += collisions;
+    return best;
+  }
+
+  if (aspiration == true && self->kind != AI_ENGINE_BEST_FIRST)
+  {
+    alpha = MAX((int64)*value - delta, INT32_MIN);
+    beta = MIN((int64)*value + delta, INT32_MAX);
+  }
+
+  for (;;)
+  {
+    best = minmax_search_window(self->engine, bits, depth, (int32)alpha,
+      (int32)beta, &result);
+    minmax_get_stats(self->engine, &visited, &pruned);
+    self->visited += visited;
+    self->pruned += pruned;
+    minmax_get_table_stats(self->engine, &hits, &misses, &collisions);
+    self->table_hits += hits;
+    self->table_misses += misses;
+    self->table_collisions += collisions;
+    if (best == BOTTOM_OF_DIRECTION)
+    {
+      break;
+    }
+    delta *= 4;
+    if (result <= alpha && alpha > INT32_MIN)
+    {
+      alpha = MAX((int64)result - delta, INT32_MIN);
+    }
+    else if (result >= beta && beta < INT32_MAX)
+    {
+      beta = MIN((int64)result + delta, INT32_MAX);
+    }
+    else
+    {
+      break;
+    }
+  }
+  *value = result;
+
+  return best;
+}
+
+/*
+ * The search boards are made for the first board of a shape and kept
+ * until one of another shape comes, so a game allocates them once.  If
+ * only some could be made, they stay for ai_get_greedy and the next move
+ * tries again.
+ */
+static bool ai_shape_boards(ai *self, board *b)
+{
+  bool ret = true;
+  uint32 rows = board_get_rows(b), cols = board_get_cols(b);
+  uint32 i = 0;
+
+  if (self->moved[AI_BOARD_DEPTH - 1] != NULL
+    && board_get_rows(self->moved[0]) == rows
+    && board_get_cols(self->moved[0]) == cols)
+  {
+    return ret;
+  }
+
+  ai_free_boards(self);
+  for (i = 0; i < AI_BOARD_DEPTH - 1 && ret == true; i++)
+  {
+    ret = board_create(&self->moved[i], rows, cols);
+    ret &= board_create(&self->spawned[i], rows, cols);
+  }
+  if (ret == true)
+  {
+    ret = board_create(&self->moved[i], rows, cols);
+  }
+
+  return ret;
+}
+
+static void ai_free_boards(ai *self)
+{
+  uint32 i = 0;
+
+  for (i = 0; i < AI_BOARD_DEPTH; i++)
+  {
+    board_destory(&self->moved[i]);
+  }
+  for (i = 0; i < AI_BOARD_DEPTH - 1; i++)
+  {
+    board_destory(&self->spawned[i]);
+  }
+}
+
+static enum direction ai_get_board(ai *self, board *b)
+{
+  enum direction best = BOTTOM_OF_DIRECTION;
+
+  if (ai_shape_boards(self, b) == false)
+  {
+    return ai_get_greedy(self, b);
+  }
+  ai_board_player(self, b, 0, &best);
+
+  return best;
+}
+
+/* the best move of b, valued at depth moves in; a lost board is worth -1 */
+static int32 ai_board_player(ai *self, board *b, uint32 depth,
+  enum direction *best)
+{
+  enum direction dir = UP;
+  uint32 legal = calculator_legal_moves_board(self->calc, b);
+  uint64 score = 0;
+  int32 value = -1, child = 0;
+  board *next = self->moved[depth];
+
+  for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+  {
+    if ((legal & CALCULATOR_MOVE_BIT(dir)) == 0)
+    {
+      continue;
+    }
+    board_move(b, next, dir, &score);
+    child = ai_board_chance(self, next, depth + 1);
+    if (child > value)
+    {
+      value = child;
+      if (best != NULL)
+      {
+        *best = dir;
+      }
+    }
+  }
+
+  return value;
+}
+
+/* the mean over the sampled spawns, empty cells in EVALUATOR_ONE units */
+static int32 ai_board_chance(ai *self, board *b, uint32 depth)
+{
+  uint64 cells[MAX_ROWS_OF_BOARD * MAX_COLS_OF_BOARD];
+  uint32 values[] = GAME_NUBMER_ELEMENTS;
+  uint32 len = 0, count = 0, i = 0, j = 0;
+  int64 sum = 0;
+  board *spawned = NULL;
+
+  board_get_empty(b, cells, &len);
+  if (depth == AI_BOARD_DEPTH || len == 0)
+  {
+    return (int32)len * EVALUATOR_ONE;
+  }
+
+  spawned = self->spawned[depth - 1];
+  count = MIN(len, AI_BOARD_SAMPLE);
+  for (i = 0; i < count; i++)
+  {
+    for (j = 0; j < ARRAY_SIZE(values); j++)
+    {
+      board_clone_data(spawned, b);
+      board_set_value_by_pos(spawned, cells[i * len / count], values[j]);
+      sum += ai_board_player(self, spawned, depth, NULL);
+    }
+  }
+
+  return (int32)(sum / (int64)(count * ARRAY_SIZE(values)));
+}
+
+/*
+ * The last resort when the search boards cannot be made: the legal move
+ * that leaves the most empty cells, or with no board to try it in, the
+ * first legal move.
+ */
+static enum direction ai_get_greedy(ai *self, board *b)
+{
+  enum direction best = BOTTOM_OF_DIRECTION;
+  enum direction dir = UP;
+  uint64 pos_array[MAX_ROWS_OF_BOARD * MAX_COLS_OF_BOARD];
+  uint32 len = 0, best_len = 0;
+  uint32 legal = calculator_legal_moves_board(self->calc, b);
+  board *next = self->moved[0];
+
+  for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+  {
+    if ((legal & CALCULATOR_MOVE_BIT(dir)) == 0)
+    {
+      continue;
+    }
+    if (next == NULL)
+    {
+      return dir;
+    }
+    calculator_move_board(self->calc, b, next, dir);
+    board_get_empty(next, pos_array, &len);
+    if (best == BOTTOM_OF_DIRECTION || len > best_len)
+    {
+      best = dir;
+      best_len = len;
+    }
+  }
+
+  return best;
+}
@@ -6,9 +6,23 @@
 
 typedef struct _ai ai;
 
+enum ai_engine
+{
+  AI_ENGINE_MINMAX      = 0,    /* the computer spawns at its worst */
+  AI_ENGINE_EXPECTIMAX  = 1,    /* the computer spawns at random */
+  AI_ENGINE_MINMAX_TREE = 2,    /* minmax on a tree kept between moves */
+  AI_ENGINE_BEST_FIRST  = 3,    /* that tree grown where the move is decided */
+  BOTTOM_OF_AI_ENGINE
+};
+
 bool ai_create(ai **self);
 void ai_destory(ai **self);
 void ai_set_thinking_duration(ai *self, uint32 duration);
+bool ai_load_weights(ai *self, const char *path);
+void ai_set_weights(ai *self, float smoothness, float monotonicity,
+  float empty, float max_value);
+bool ai_set_table_size(ai *self, uint32 megabytes);
+bool ai_set_engine(ai *self, enum ai_engine engine);
 enum direction ai_get(ai *self, board *b);
 
 #endif /* __AI_H__ */
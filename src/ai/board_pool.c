@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include "board_pool.h"
 #include "list.h"
 
@@ -60,7 +61,6 @@ board_data *board_pool_get(board_pool *self)
     if (list_is_empty(self->board_list) == true)
     {
       bd = (board_data*)malloc(sizeof(board_data));
-      board_create(&bd->b, ROWS_OF_BOARD, COLS_OF_BOARD);
     }
     else
     {
@@ -71,10 +71,15 @@ board_data *board_pool_get(board_pool *self)
   if (bd != NULL)
   {
     bd->dir = BOTTOM_OF_DIRECTION;
+    bd->best = BOTTOM_OF_DIRECTION;
     bd->r = BOTTOM_OF_ROUND;
-    bd->value = 0.0;
+    bd->b = 0;
+    bd->hash = 0;
+    bd->value = 0;
     bd->alpha = INT32_MAX;
     bd->beta = INT32_MIN;
+    bd->expansions = 0;
+    bd->solved = false;
   }
 
   return bd;
@@ -94,7 +99,6 @@ static void board_pool_release_all(board_pool *self)
   bd = (board_data *)list_get_from_first(self->board_list);
   while (bd != NULL)
   {
-    board_destory(&bd->b);
     free(bd);
     bd = (board_data *)list_get_from_first(self->board_list);
   }
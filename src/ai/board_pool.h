@@ -2,18 +2,22 @@
 #define __BOARD_POOL_H__
 
 #include "constants.h"
-#include "../models/board.h"
+#include "../models/bitboard.h"
 
 typedef struct _board_pool board_pool;
 
 typedef struct _board_data
 {
   enum direction  dir;
+  enum direction  best;       /* best move the last search found here */
   enum round      r;
-  board           *b;
-  double          value;
+  bitboard        b;
+  uint64          hash;
+  int32           value;      /* fixed point, see evaluator.h */
   int32           alpha;
   int32           beta;
+  uint32          expansions; /* leaves grown below, best first */
+  bool            solved;     /* no leaf below is left to grow */
 } board_data;
 
 bool board_pool_create(board_pool **self);
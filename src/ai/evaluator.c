@@ -1,13 +1,31 @@
 #include <stdlib.h>
-#include <math.h>
 #include "evaluator.h"
 
+/*
+ * Direct-mapped cache of board -> value, 16K entries or 256KB so that it
+ * stays in L2.  An evaluator belongs to the thread searching with it, so
+ * every thread has a cache of its own and needs no locking.  Free slots
+ * hold the empty board with its real value, so a slot never needs a valid
+ * flag.
+ */
+#define EVALUATOR_CACHE_BITS      14
+#define EVALUATOR_CACHE_SIZE      (1U << EVALUATOR_CACHE_BITS)
+
+typedef struct _evaluator_cache_entry
+{
+  bitboard  b;
+  int32     value;
+} evaluator_cache_entry;
+
 typedef struct _evaluator
 {
-  double   smoothness_weight;
-  double   monotonicity_weight;
-  double   empty_weight;
-  double   max_value_weight;
+  int32                   smoothness_weight;    /* fixed point */
+  int32                   monotonicity_weight;
+  int32                   empty_weight;
+  int32                   max_value_weight;
+  evaluator_cache_entry   *cache;
+  uint64                  cache_hits;
+  uint64                  cache_misses;
 } evaluator;
 
 #define MAX(a, b)   (((a) >= (b)) ? (a) : (b))
@@ -17,10 +35,134 @@ typedef struct _evaluator
 #define EMPTY_WEIGHT              2.7
 #define MAX_VALUE_WEIGHT          1.0
 
-static void evaluator_check_around(evaluator *self, board *b, uint32 x,
-  uint32 y, uint32 value, bool **flags);
-static bool evluator_find_farthest_pos(evaluator *self, board *b, uint32 x,
-  uint32 y, uint32 *target_x, uint32 *target_y, enum direction dir);
+/*
+ * Smoothness and monotonicity only ever compare tiles of the same row or
+ * the same column, so both split into per-line terms.  They are tabulated
+ * for every 16-bit row; a column is a row of the transposed board.
+ */
+typedef struct _evaluator_row
+{
+  int8    smoothness;
+  int8    left;         /* monotonicity totals along the row */
+  int8    right;
+  uint8   max;          /* largest exponent */
+} evaluator_row;
+
+typedef struct _evaluator_lines
+{
+  int32   smoothness;
+  int32   monotonicity;
+  uint32  max;
+} evaluator_lines;
+
+static evaluator_row evaluator_rows[1 << BITBOARD_ROW_BITS];
+
+/* log(n) for n empty cells, spelled out so the values match libm exactly */
+static const double evaluator_log_empty[BITBOARD_CELLS + 1] =
+{
+  0,
+  0,
+  0.69314718055994529,
+  1.0986122886681098,
+  1.3862943611198906,
+  1.6094379124341003,
+  1.791759469228055,
+  1.9459101490553132,
+  2.0794415416798357,
+  2.1972245773362196,
+  2.3025850929940459,
+  2.3978952727983707,
+  2.4849066497880004,
+  2.5649493574615367,
+  2.6390573296152584,
+  2.7080502011022101,
+  2.7725887222397811,
+};
+
+static int32 evaluator_log_empty_fixed[BITBOARD_CELLS + 1];
+
+/* one bit per cell, cell (x, y) at bit y * BITBOARD_COLS + x */
+#define EVALUATOR_PLANE_MASK      0xFFFFU
+#define EVALUATOR_PLANE_FIRST_COL 0x1111U
+#define EVALUATOR_PLANE_LAST_COL  0x8888U
+
+static void evaluator_get_lines(bitboard b, evaluator_lines *lines);
+static inline int32 evaluator_value(const evaluator *self, bitboard b);
+static inline evaluator_cache_entry *evaluator_cache_slot(evaluator *self,
+  bitboard b);
+static inline int32 evaluator_cached_value(evaluator *self, bitboard b);
+static int32 evaluator_to_fixed(double value);
+static void evaluator_clear_cache(evaluator *self);
+static uint32 evaluator_plane_neighbours(uint32 cells);
+static uint32 evaluator_plane_grow(uint32 seed, uint32 plane);
+
+/*
+ * Fill evaluator_rows by walking a row the way the board-wide loops used
+ * to: every tile against the next tile to its right for smoothness, and
+ * the same pairing (empty cells included) for monotonicity.  The empty
+ * cell logarithms get their fixed point copy here too.
+ */
+static void __attribute__((constructor)) evaluator_init_tables(void)
+{
+  uint32 row = 0;
+  uint32 line[BITBOARD_COLS];
+  uint32 current = 0, next = 0;
+  uint32 i = 0, j = 0;
+  evaluator_row *er = NULL;
+
+  for (i = 0; i < ARRAY_SIZE(evaluator_log_empty); i++)
+  {
+    evaluator_log_empty_fixed[i] = evaluator_to_fixed(evaluator_log_empty[i]);
+  }
+
+  for (row = 0; row < ARRAY_SIZE(evaluator_rows); row++)
+  {
+    er = &evaluator_rows[row];
+    er->smoothness = 0;
+    er->left = 0;
+    er->right = 0;
+    er->max = 0;
+    for (i = 0; i < BITBOARD_COLS; i++)
+    {
+      line[i] = (row >> (i * BITBOARD_CELL_BITS)) & BITBOARD_CELL_MASK;
+      er->max = MAX(er->max, line[i]);
+    }
+
+    for (i = 0; i < BITBOARD_COLS; i++)
+    {
+      if (line[i] == 0)
+      {
+        continue;
+      }
+      for (j = i + 1; j < BITBOARD_COLS && line[j] == 0; j++);
+      if (j < BITBOARD_COLS)
+      {
+        er->smoothness -= abs((int32)line[i] - (int32)line[j]);
+      }
+    }
+
+    /* an empty next cell is paired with the last cell of the row */
+    current = 0;
+    next = current + 1;
+    while (next < BITBOARD_COLS)
+    {
+      if (line[next] == 0)
+      {
+        next = BITBOARD_COLS - 1;
+      }
+      if (line[current] > line[next])
+      {
+        er->left += (int32)line[next] - (int32)line[current];
+      }
+      else if (line[next] > line[current])
+      {
+        er->right += (int32)line[current] - (int32)line[next];
+      }
+      current = next;
+      next++;
+    }
+  }
+}
 
 bool evaluator_create(evaluator **self)
 {
@@ -29,11 +171,23 @@ bool evaluator_create(evaluator **self)
   *self = (evaluator *)malloc(sizeof(evaluator));
   if (*self != NULL)
   {
-    ret = true;
-    (*self)->smoothness_weight = SMOOTHNESS_WEIGHT;
-    (*self)->monotonicity_weight = MONOTONICITY_WEIGHT;
-    (*self)->empty_weight = EMPTY_WEIGHT;
-    (*self)->max_value_weight = MAX_VALUE_WEIGHT;
+    (*self)->smoothness_weight = evaluator_to_fixed(SMOOTHNESS_WEIGHT);
+    (*self)->monotonicity_weight = evaluator_to_fixed(MONOTONICITY_WEIGHT);
+    (*self)->empty_weight = evaluator_to_fixed(EMPTY_WEIGHT);
+    (*self)->max_value_weight = evaluator_to_fixed(MAX_VALUE_WEIGHT);
+    (*self)->cache = (evaluator_cache_entry *)malloc(
+      sizeof(evaluator_cache_entry) * EVALUATOR_CACHE_SIZE);
+    if ((*self)->cache != NULL)
+    {
+      evaluator_clear_cache(*self);
+      evaluator_reset_cache_stats(*self);
+      ret = true;
+    }
+    else
+    {
+      free(*self);
+      *self = NULL;
+    }
   }
 
   return ret;
@@ -43,6 +197,7 @@ void evaluator_destory(evaluator **self)
 {
   if (*self != NULL)
   {
+    free((*self)->cache);
     free(*self);
     *self = NULL;
   }
@@ -50,391 +205,345 @@ void evaluator_destory(evaluator **self)
 
 void evaluator_set_smoothness_weight(evaluator *self, float weight)
 {
-  if (self != NULL)
+  if (self != NULL && self->smoothness_weight != evaluator_to_fixed(weight))
   {
-    self->smoothness_weight = weight;
+    self->smoothness_weight = evaluator_to_fixed(weight);
+    evaluator_clear_cache(self);
   }
 }
 
 void evaluator_set_monotonicity_weight(evaluator *self, float weight)
 {
-  if (self != NULL)
+  if (self != NULL && self->monotonicity_weight != evaluator_to_fixed(weight))
   {
-    self->monotonicity_weight = weight;
+    self->monotonicity_weight = evaluator_to_fixed(weight);
+    evaluator_clear_cache(self);
   }
 }
 
 void evaluator_set_empty_weight(evaluator *self, float weight)
 {
-  if (self != NULL)
+  if (self != NULL && self->empty_weight != evaluator_to_fixed(weight))
   {
-    self->empty_weight = weight;
+    self->empty_weight = evaluator_to_fixed(weight);
+    evaluator_clear_cache(self);
   }
 }
 
 void evaluator_set_max_value_weight(evaluator *self, float weight)
 {
+  if (self != NULL && self->max_value_weight != evaluator_to_fixed(weight))
+  {
+    self->max_value_weight = evaluator_to_fixed(weight);
+    evaluator_clear_cache(self);
+  }
+}
+
+int32 evaluator_get_value(evaluator *self, bitboard b)
+{
+  int32 value = 0;
+
   if (self != NULL)
   {
-    self->max_value_weight = weight;
+    value = evaluator_cached_value(self, b);
   }
+  //LOG("value is %d", value);
+  return value;
 }
 
-double evaluator_get_value(evaluator *self, board *b)
+/*
+ * out[i] = evaluator_get_value(self, boards[i]) for the n boards.  The
+ * cache slots of all of them are fetched before the first is read, so
+ * their misses overlap instead of coming one after the other.
+ */
+void evaluator_get_values(evaluator *self, const bitboard *boards, size_t n,
+  int32 *out)
 {
-  double smoothness = 0.0;
-  double monotonicity = 0.0;
-  double empty = 0.0;
-  double max_value = 0.0;
-  double value = 0.0;
+  size_t i = 0;
+
+  if (self == NULL || boards == NULL || out == NULL)
+  {
+    return;
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    __builtin_prefetch(evaluator_cache_slot(self, boards[i]));
+  }
+  for (i = 0; i < n; i++)
+  {
+    out[i] = evaluator_cached_value(self, boards[i]);
+  }
+}
 
+void evaluator_get_cache_stats(evaluator *self, uint64 *hits, uint64 *misses)
+{
   if (self != NULL)
   {
-    smoothness = (double)evaluator_smoothness(self, b) * self->smoothness_weight;
-    monotonicity = (double)evaluator_monotonicity(self, b) * self->monotonicity_weight;
-    empty = evaluator_empty(self, b) * self->empty_weight;
-    max_value = (double)evaluator_max_value(self, b) * self->max_value_weight;
+    *hits = self->cache_hits;
+    *misses = self->cache_misses;
   }
+}
 
-  value = smoothness + monotonicity + empty + max_value;
-  //LOG("value is %.13f", value);
-  return value;
+void evaluator_reset_cache_stats(evaluator *self)
+{
+  if (self != NULL)
+  {
+    self->cache_hits = 0;
+    self->cache_misses = 0;
+  }
 }
 
-uint32 evaluator_islands(evaluator *self, board *b)
+/*
+ * Tiles of one exponent form a 16-bit plane; each island is grown from its
+ * lowest cell by dilating within the plane until it stops changing.
+ */
+uint32 evaluator_islands(evaluator *self, bitboard b)
 {
   uint32 islands = 0;
-  uint32 rows = 0, cols = 0;
-  uint32 val = 0;
-  uint32 x = 0, y = 0;
-  bool **flags = NULL;
+  uint32 rest = 0, plane = 0;
+  uint32 exp = 0;
 
-  if (self != NULL && b != NULL)
+  if (self != NULL)
   {
-    rows = board_get_rows(b);
-    cols = board_get_cols(b);
-    flags = (bool **)malloc(sizeof(bool *) * rows);
-    if (flags != NULL)
+    rest = bitboard_empty_mask(b) ^ EVALUATOR_PLANE_MASK;
+    while (rest != 0)
     {
-      flags[0] = (bool *)malloc(sizeof(bool) * rows * cols);
-      if (flags[0] != NULL)
+      exp = (uint32)(b >> (__builtin_ctz(rest) * BITBOARD_CELL_BITS))
+        & BITBOARD_CELL_MASK;
+      plane = bitboard_empty_mask(b ^ (exp * 0x1111111111111111ULL));
+      rest &= ~plane;
+      while (plane != 0)
       {
-        for (y = 0; y < rows; y++)
-        {
-          flags[y] = flags[0] + y * cols;
-          for (x = 0; x < cols; x++)
-          {
-            flags[y][x] = false;
-          }
-        }
-
-        for (x = 0; x < cols; x++)
-        {
-          for (y = 0; y < rows; y++)
-          {
-            val = board_get_value(b, x, y);
-            if (val != 0 && flags[y][x] == false)
-            {
-              islands++;
-              evaluator_check_around(self, b, x, y, val, flags);
-            }
-          }
-        }
-        free(flags[0]);
+        plane &= ~evaluator_plane_grow(plane & (0 - plane), plane);
+        islands++;
       }
-      free(flags);
     }
   }
   //LOG("islands = %u", islands);
   return islands;
 }
 
-int32 evaluator_smoothness(evaluator *self, board *b)
+/*
+ * A spawn only touches its own row and column, and can only merge the
+ * islands of its exponent that it borders.  For every empty cell of b,
+ * smoothness[cell] and islands[cell] receive the change that placing exp
+ * there would make; both arrays hold BITBOARD_CELLS entries.  Returns the
+ * mask of the cells that were written.
+ */
+uint32 evaluator_spawn_deltas(evaluator *self, bitboard b, uint32 exp,
+  int32 *smoothness, int32 *islands)
 {
-  int32 smoothness = 0;
-  uint32 rows = 0, cols = 0;
-  uint32 val = 0, target_val = 0;
-  int32 value = 0, target_value = 0;
-  uint32 x = 0, y = 0;
-  uint32 target_x = 0, target_y = 0;
-  enum direction dir = BOTTOM_OF_DIRECTION;
-
-  if (self != NULL && b != NULL)
+  bitboard t = 0;
+  uint32 empty = 0, rest = 0, plane = 0, border = 0;
+  uint32 cell = 0, x = 0, y = 0;
+  uint32 row = 0, col = 0;
+
+  if (self == NULL || exp == 0 || exp > BITBOARD_MAX_EXPONENT)
   {
-    rows = board_get_rows(b);
-    cols = board_get_cols(b);
-    for (x = 0; x < cols; x++)
+    return empty;
+  }
+
+  t = bitboard_transpose(b);
+  empty = bitboard_empty_mask(b);
+  plane = bitboard_empty_mask(b ^ (exp * 0x1111111111111111ULL));
+  rest = empty;
+  while (rest != 0)
+  {
+    cell = (uint32)__builtin_ctz(rest);
+    rest &= rest - 1;
+    x = cell % BITBOARD_COLS;
+    y = cell / BITBOARD_COLS;
+    row = bitboard_get_row(b, y);
+    col = bitboard_get_row(t, x);
+    smoothness[cell] =
+      evaluator_rows[row | (exp << (x * BITBOARD_CELL_BITS))].smoothness
+      - evaluator_rows[row].smoothness
+      + evaluator_rows[col | (exp << (y * BITBOARD_CELL_BITS))].smoothness
+      - evaluator_rows[col].smoothness;
+
+    islands[cell] = 1;
+    border = evaluator_plane_neighbours((uint32)1 << cell) & plane;
+    while (border != 0)
     {
-      for (y = 0; y < rows; y++)
-      {
-        val = board_get_value(b, x, y);
-        if (val != 0)
-        {
-          value = log(val) / log(2);
-          for (dir = DOWN; dir < BOTTOM_OF_DIRECTION; dir += 2)
-          {
-            if (evluator_find_farthest_pos(self, b, x, y, &target_x, &target_y,
-              dir) == true)
-            {
-              target_val = board_get_value(b, target_x, target_y);
-              if (target_val != 0)
-              {
-                target_value = log(target_val) / log(2);
-                smoothness -= abs(value - target_value);
-              }
-            }
-          }
-        }
-      }
+      border &= ~evaluator_plane_grow(border & (0 - border), plane);
+      islands[cell]--;
     }
   }
-  //LOG("smoothness is %d", smoothness);
-  return smoothness;
+
+  return empty;
 }
 
-int32 evaluator_monotonicity(evaluator *self, board *b)
+int32 evaluator_smoothness(evaluator *self, bitboard b)
 {
-  int32 monotonicity = 0;
-  int32 totals[BOTTOM_OF_DIRECTION] = {0, 0, 0, 0};
-  uint32 rows = 0, cols = 0;
-  uint32 x = 0, y = 0;
-  uint32 current = 0, next = 0;
-  uint32 val = 0, current_val = 0, next_val = 0;
+  evaluator_lines lines = {0, 0, 0};
 
-  if (self != NULL && b != NULL)
+  if (self != NULL)
   {
-    rows = board_get_rows(b);
-    cols = board_get_cols(b);
+    evaluator_get_lines(b, &lines);
+  }
+  //LOG("smoothness is %d", lines.smoothness);
+  return lines.smoothness;
+}
 
-    // LEFT and RIGHT
-    for (y = 0; y < rows; y++)
-    {
-      current = 0;
-      next = current + 1;
-      while (next < cols)
-      {
-        val = board_get_value(b, next, y);
-        while (next < cols && val == 0)
-        {
-          next++;
-        }
-        if (next >= cols)
-        {
-          next--;
-        }
-        val = board_get_value(b, next, y);
-        if (val != 0)
-        {
-          next_val = log(val) / log(2);
-        }
-        else
-        {
-          next_val = 0;
-        }
-        val = board_get_value(b, current, y);
-        if (val != 0)
-        {
-          current_val = log(val) / log(2);
-        }
-        else
-        {
-          current_val = 0;
-        }
-        if (current_val > next_val)
-        {
-          totals[LEFT] += next_val - current_val;
-        }
-        else if (next_val > current_val)
-        {
-          totals[RIGHT] += current_val - next_val;
-        }
-        current = next;
-        next++;
-      }
-    }
+int32 evaluator_monotonicity(evaluator *self, bitboard b)
+{
+  evaluator_lines lines = {0, 0, 0};
 
-    // UP and DOWN
-    for (x = 0; x < cols; x++)
-    {
-      current = 0;
-      next = current + 1;
-      while (next < rows)
-      {
-        val = board_get_value(b, x, next);
-        while (next < rows && val == 0)
-        {
-          next++;
-        }
-        if (next >= rows)
-        {
-          next--;
-        }
-        val = board_get_value(b, x, next);
-        if (val != 0)
-        {
-          next_val = log(val) / log(2);
-        }
-        else
-        {
-          next_val = 0;
-        }
-        val = board_get_value(b, x, current);
-        if (val != 0)
-        {
-          current_val = log(val) / log(2);
-        }
-        else
-        {
-          current_val = 0;
-        }
-        if (current_val > next_val)
-        {
-          totals[UP] += next_val - current_val;
-        }
-        else if (next_val > current_val)
-        {
-          totals[DOWN] += current_val - next_val;
-        }
-        current = next;
-        next++;
-      }
-    }
+  if (self != NULL)
+  {
+    evaluator_get_lines(b, &lines);
   }
-  monotonicity = MAX(totals[UP], totals[DOWN])
-     +  MAX(totals[LEFT], totals[RIGHT]);
-  //LOG("monotonicity is %d", monotonicity);
-  return monotonicity;
+  //LOG("monotonicity is %d", lines.monotonicity);
+  return lines.monotonicity;
 }
 
-double evaluator_empty(evaluator *self, board *b)
+double evaluator_empty(evaluator *self, bitboard b)
 {
-  uint64 *pos_array = NULL;
   uint32 empty_count = 0;
 
-  if (self != NULL && b != NULL)
+  if (self != NULL)
   {
-    board_get_empty(b, &pos_array, &empty_count);
-    free(pos_array);
+    empty_count = bitboard_count_empty(b);
   }
 
-  //LOG("empty is %f", log(empty_count));
-  if (empty_count == 0)
-  {
-    return 0;
-  }
-  else
+  //LOG("empty is %f", evaluator_log_empty[empty_count]);
+  return evaluator_log_empty[empty_count];
+}
+
+uint32 evaluator_max_value(evaluator *self, bitboard b)
+{
+  evaluator_lines lines = {0, 0, 0};
+
+  if (self != NULL)
   {
-    return log(empty_count);
+    evaluator_get_lines(b, &lines);
   }
+  //LOG("max value is %u", lines.max);
+  return lines.max;
 }
 
-uint32 evaluator_max_value(evaluator *self, board *b)
+/* exponent of the highest power of two not above the sum of the tiles */
+uint32 evaluator_sum(evaluator *self, bitboard b)
 {
-  uint32 max = 0;
-  uint32 x = 0, y = 0;
+  uint32 sum = 0;
+  uint32 cell = 0;
 
-  if (self != NULL && b != NULL)
+  if (self != NULL)
   {
-    uint32 rows = board_get_rows(b);
-    uint32 cols = board_get_cols(b);
-
-    for (x = 0; x < cols; x++)
+    for (cell = 0; cell < BITBOARD_CELLS; cell++)
     {
-      for (y = 0; y < rows; y++)
-      {
-        max = MAX(max, board_get_value(b, x, y));
-      }
+      sum += bitboard_exponent_to_value(
+        (uint32)(b >> (cell * BITBOARD_CELL_BITS)) & BITBOARD_CELL_MASK);
     }
   }
-  //LOG("max value is %u", (uint32)(log(max) / log(2)));
-  return (uint32)(log(max) / log(2));
+  return (sum == 0) ? 0 : 31 - (uint32)__builtin_clz(sum);
 }
 
-uint32 evaluator_sum(evaluator *self, board *b)
+static inline int32 evaluator_value(const evaluator *self, bitboard b)
 {
-  uint64 sum = 0;
-  uint32 x = 0, y = 0;
+  evaluator_lines lines;
+  int32 smoothness = 0;
+  int32 monotonicity = 0;
+  int32 empty = 0;
+  int32 max_value = 0;
 
-  if (self != NULL && b != NULL)
-  {
-    uint32 rows = board_get_rows(b);
-    uint32 cols = board_get_cols(b);
+  evaluator_get_lines(b, &lines);
+  smoothness = lines.smoothness * self->smoothness_weight;
+  monotonicity = lines.monotonicity * self->monotonicity_weight;
+  empty = evaluator_log_empty_fixed[bitboard_count_empty(b)]
+    * self->empty_weight / EVALUATOR_ONE;
+  max_value = (int32)lines.max * self->max_value_weight;
 
-    for (x = 0; x < cols; x++)
-    {
-      for (y = 0; y < rows; y++)
-      {
-        sum += board_get_value(b, x, y);
-      }
-    }
+  return smoothness + monotonicity + empty + max_value;
+}
+
+static inline evaluator_cache_entry *evaluator_cache_slot(evaluator *self,
+  bitboard b)
+{
+  return &self->cache[(b * 0x9E3779B97F4A7C15ULL)
+    >> (64 - EVALUATOR_CACHE_BITS)];
+}
+
+static inline int32 evaluator_cached_value(evaluator *self, bitboard b)
+{
+  evaluator_cache_entry *entry = evaluator_cache_slot(self, b);
+
+  if (entry->b == b)
+  {
+    self->cache_hits++;
+  }
+  else
+  {
+    self->cache_misses++;
+    entry->b = b;
+    entry->value = evaluator_value(self, b);
   }
-  return (uint32)(log(sum) / log(2));
+
+  return entry->value;
 }
 
-static void evaluator_check_around(evaluator *self, board *b, uint32 x,
-  uint32 y, uint32 value, bool **flags)
+static void evaluator_clear_cache(evaluator *self)
 {
-  uint32 rows = board_get_rows(b);
-  uint32 cols = board_get_cols(b);
-  if (x < cols && y < rows && flags[y][x] == false)
+  int32 value = evaluator_value(self, 0);
+  uint32 i = 0;
+
+  for (i = 0; i < EVALUATOR_CACHE_SIZE; i++)
   {
-    uint32 current_value = board_get_value(b, x, y);
-    if (current_value != 0 && current_value == value)
-    {
-      flags[y][x] = true;
-      if (y > 0)
-      {
-        evaluator_check_around(self, b, x, y - 1, value, flags);
-      }
-      if (x > 0)
-      {
-        evaluator_check_around(self, b, x - 1, y, value, flags);
-      }
-      evaluator_check_around(self, b, x, y + 1, value, flags);
-      evaluator_check_around(self, b, x + 1, y, value, flags);
-    }
+    self->cache[i].b = 0;
+    self->cache[i].value = value;
   }
 }
 
-static bool evluator_find_farthest_pos(evaluator *self, board *b, uint32 x,
-  uint32 y, uint32 *target_x, uint32 *target_y, enum direction dir)
+/* nearest fixed point value, halves rounded away from zero */
+static int32 evaluator_to_fixed(double value)
 {
-  bool ret = false;
-  uint32 rows = board_get_rows(b);
-  uint32 cols = board_get_cols(b);
-  uint32 val = 0;
+  return (int32)(value * EVALUATOR_ONE + ((value >= 0) ? 0.5 : -0.5));
+}
+
+/* four row lookups, then four more on the transposed board for the columns */
+static void evaluator_get_lines(bitboard b, evaluator_lines *lines)
+{
+  bitboard t = bitboard_transpose(b);
+  int32 totals[BOTTOM_OF_DIRECTION] = {0, 0, 0, 0};
+  const evaluator_row *row = NULL, *col = NULL;
+  uint32 y = 0;
 
-  switch (dir)
+  lines->smoothness = 0;
+  lines->max = 0;
+  for (y = 0; y < BITBOARD_ROWS; y++)
   {
-    case DOWN:
-      *target_x = x;
-      do {
-        *target_y = y + 1;
-        y = *target_y;
-        val = board_get_value(b, x, y);
-        if (val != 0)
-        {
-          ret = true;
-          break;
-        }
-      } while(*target_y < rows);
-      break;
-    case RIGHT:
-      *target_y = y;
-      do {
-        *target_x = x + 1;
-        x = *target_x;
-        val = board_get_value(b, x, y);
-        if (val != 0)
-        {
-          ret = true;
-          break;
-        }
-      } while(*target_x < cols);
-      break;
-    default:
-      break;
+    row = &evaluator_rows[bitboard_get_row(b, y)];
+    col = &evaluator_rows[bitboard_get_row(t, y)];
+    lines->smoothness += row->smoothness + col->smoothness;
+    totals[LEFT] += row->left;
+    totals[RIGHT] += row->right;
+    totals[UP] += col->left;
+    totals[DOWN] += col->right;
+    lines->max = MAX(lines->max, row->max);
   }
+  lines->monotonicity = MAX(totals[UP], totals[DOWN])
+    + MAX(totals[LEFT], totals[RIGHT]);
+}
 
-  return ret;
+/* cells plus the cells next to them */
+static uint32 evaluator_plane_neighbours(uint32 cells)
+{
+  return (cells | (cells << BITBOARD_COLS) | (cells >> BITBOARD_COLS)
+    | ((cells << 1) & ~EVALUATOR_PLANE_FIRST_COL)
+    | ((cells >> 1) & ~EVALUATOR_PLANE_LAST_COL)) & EVALUATOR_PLANE_MASK;
+}
+
+/* the cells of plane connected to seed, seed must lie inside plane */
+static uint32 evaluator_plane_grow(uint32 seed, uint32 plane)
+{
+  uint32 island = 0;
+
+  do
+  {
+    island = seed;
+    seed = evaluator_plane_neighbours(island) & plane;
+  } while (seed != island);
+
+  return island;
 }
@@ -2,22 +2,38 @@
 #define __EVALUATOR_H__
 
 #include "constants.h"
-#include "../models/board.h"
+#include "../models/bitboard.h"
 
 typedef struct _evaluator evaluator;
 
+/*
+ * Values are fixed point with EVALUATOR_SCALE_BITS fraction bits, so
+ * EVALUATOR_ONE stands for 1.0; the weight setters take plain floats.
+ */
+#define EVALUATOR_SCALE_BITS  12
+#define EVALUATOR_ONE         (1 << EVALUATOR_SCALE_BITS)
+
+/* no evaluation goes past +-EVALUATOR_MAX, search losses lie beyond it */
+#define EVALUATOR_MAX         (1 << 30)
+
 bool evaluator_create(evaluator **self);
 void evaluator_destory(evaluator **self);
 void evaluator_set_smoothness_weight(evaluator *self, float weight);
 void evaluator_set_monotonicity_weight(evaluator *self, float weight);
 void evaluator_set_empty_weight(evaluator *self, float weight);
 void evaluator_set_max_value_weight(evaluator *self, float weight);
-double evaluator_get_value(evaluator *self, board *b);
-uint32 evaluator_islands(evaluator *self, board *b);
-int32 evaluator_smoothness(evaluator *self, board *b);
-int32 evaluator_monotonicity(evaluator *self, board *b);
-double evaluator_empty(evaluator *self, board *b);
-uint32 evaluator_max_value(evaluator *self, board *b);
-uint32 evaluator_sum(evaluator *self, board *b);
+int32 evaluator_get_value(evaluator *self, bitboard b);
+void evaluator_get_values(evaluator *self, const bitboard *boards, size_t n,
+  int32 *out);
+void evaluator_get_cache_stats(evaluator *self, uint64 *hits, uint64 *misses);
+void evaluator_reset_cache_stats(evaluator *self);
+uint32 evaluator_islands(evaluator *self, bitboard b);
+uint32 evaluator_spawn_deltas(evaluator *self, bitboard b, uint32 exp,
+  int32 *smoothness, int32 *islands);
+int32 evaluator_smoothness(evaluator *self, bitboard b);
+int32 evaluator_monotonicity(evaluator *self, bitboard b);
+double evaluator_empty(evaluator *self, bitboard b);
+uint32 evaluator_max_value(evaluator *self, bitboard b);
+uint32 evaluator_sum(evaluator *self, bitboard b);
 
 #endif /* __EVALUATOR_H__ */
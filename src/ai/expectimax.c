@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "expectimax.h"
+#include "../models/calculator.h"
+#include "evaluator.h"
+#include "ntuple.h"
+#include "ttable.h"
+
+/*
+ * Spawns whose path probability falls below the cutoff are valued by the
+ * evaluator instead of searched.  Chance nodes with more empty cells than
+ * the sample search that many of them, spread evenly over the board.
+ */
+#define EXPECTIMAX_CUTOFF     0.0001f
+#define EXPECTIMAX_SAMPLE     6
+
+/* a board with no moves left, beyond any evaluation */
+#define EXPECTIMAX_LOSS       (-EVALUATOR_MAX - 1)
+
+#define MIN(a, b)   (((a) <= (b)) ? (a) : (b))
+
+typedef struct _expectimax
+{
+  evaluator   *be;
+  calculator  *bc;
+  ntuple      *nt;          /* values the leaves instead of be when loaded */
+  ttable      *tt;          /* chance node values, NULL when sized to 0MB */
+  float       cutoff;
+  uint32      sample;       /* 0 searches every empty cell */
+  bitboard    root;         /* last searched board */
+  uint64      visited;      /* nodes the last search reached */
+  uint64      pruned;       /* spawns it cut off or left out of a sample */
+  uint64      cut;          /* player nodes left to the cutoff so far */
+} expectimax;
+
+static int32 expectimax_player(expectimax *self, bitboard b, uint64 hash,
+  uint32 depth, float probability, enum direction *best);
+static int32 expectimax_chance(expectimax *self, bitboard b, uint64 hash,
+  uint32 depth, float probability);
+static int32 expectimax_evaluate(expectimax *self, bitboard b);
+static void expectimax_evaluate_batch(expectimax *self, const bitboard *boards,
+  uint32 len, int32 *values);
+
+bool expectimax_create(expectimax **self)
+{
+  bool ret = false;
+
+  *self = (expectimax *)malloc(sizeof(expectimax));
+  if (*self != NULL)
+  {
+    ret = evaluator_create(&(*self)->be);
+    ret &= calculator_create(&(*self)->bc);
+    (*self)->nt = NULL;
+    ttable_create(&(*self)->tt, TABLE_SIZE_MB);
+    (*self)->cutoff = EXPECTIMAX_CUTOFF;
+    (*self)->sample = EXPECTIMAX_SAMPLE;
+    (*self)->root = 0;
+    (*self)->visited = 0;
+    (*self)->pruned = 0;
+    (*self)->cut = 0;
+    if (ret == false)
+    {
+      expectimax_destory(self);
+    }
+  }
+
+  return ret;
+}
+
+void expectimax_destory(expectimax **self)
+{
+  if (*self != NULL)
+  {
+    evaluator_destory(&(*self)->be);
+    calculator_destory(&(*self)->bc);
+    ntuple_destory(&(*self)->nt);
+    ttable_destory(&(*self)->tt);
+    free(*self);
+    *self = NULL;
+  }
+}
+
+/* value the leaves with the n-tuple network in path from now on */
+bool expectimax_load_weights(expectimax *self, const char *path)
+{
+  bool ret = false;
+  ntuple *nt = NULL;
+
+  if (self != NULL && path != NULL)
+  {
+    if (ntuple_load(&nt, path) == true)
+    {
+      ntuple_destory(&self->nt);
+      self->nt = nt;
+      ttable_clear(self->tt);
+      ret = true;
+    }
+  }
+
+  return ret;
+}
+
+/* heuristic weights, see evaluator.h */
+void expectimax_set_weights(expectimax *self, float smoothness,
+  float monotonicity, float empty, float max_value)
+{
+  if (self != NULL)
+  {
+    evaluator_set_smoothness_weight(self->be, smoothness);
+    evaluator_set_monotonicity_weight(self->be, monotonicity);
+    evaluator_set_empty_weight(self->be, empty);
+    evaluator_set_max_value_weight(self->be, max_value);
+    ttable_clear(self->tt);
+  }
+}
+
+/* a new transposition table of megabytes, none for 0 */
+bool expectimax_set_table_size(expectimax *self, uint32 megabytes)
+{
+  bool ret = false;
+  ttable *tt = NULL;
+
+  if (self != NULL)
+  {
+    if (megabytes == 0)
+    {
+      ttable_destory(&self->tt);
+      ret = true;
+    }
+    else if (ttable_create(&tt, megabytes) == true)
+    {
+      ttable_destory(&self->tt);
+      self->tt = tt;
+      ret = true;
+    }
+  }
+
+  return ret;
+}
+
+/* stored values were searched with the old settings, so they go too */
+void expectimax_set_cutoff(expectimax *self, float probability)
+{
+  if (self != NULL)
+  {
+    self->cutoff = probability;
+    ttable_clear(self->tt);
+  }
+}
+
+void expectimax_set_sample(expectimax *self, uint32 cells)
+{
+  if (self != NULL)
+  {
+    self->sample = cells;
+    ttable_clear(self->tt);
+  }
+}
+
+/* node counts of the last expectimax_search */
+void expectimax_get_stats(expectimax *self, uint64 *visited, uint64 *pruned)
+{
+  if (self != NULL)
+  {
+    *visited = self->visited;
+    *pruned = self->pruned;
+  }
+}
+
+/* transposition table counts of the last expectimax_search */
+void expectimax_get_table_stats(expectimax *self, uint64 *hits,
+  uint64 *misses, uint64 *collisions)
+{
+  *hits = 0;
+  *misses = 0;
+  *collisions = 0;
+  if (self != NULL)
+  {
+    ttable_get_stats(self->tt, hits, misses, collisions);
+  }
+}
+
+enum direction expectimax_search(expectimax *self, bitboard b, uint32 depth)
+{
+  enum direction best = BOTTOM_OF_DIRECTION;
+
+  if (self != NULL && depth != 0)
+  {
+    self->visited = 0;
+    self->pruned = 0;
+    ttable_reset_stats(self->tt);
+    if (b != self->root)
+    {
+      ttable_new_generation(self->tt);
+      self->root = b;
+    }
+    expectimax_player(self, b, bitboard_hash(b), MIN(depth, MAX_SEARCH_DEPTH)
+      - 1, 1.0f, &best);
+  }
+
+  return best;
+}
+
+static int32 expectimax_player(expectimax *self, bitboard b, uint64 hash,
+  uint32 depth, float probability, enum direction *best)
+{
+  int32 value = EXPECTIMAX_LOSS, child = 0;
+  enum direction dir = UP;
+  bitboard next = 0;
+  uint64 next_hash = 0;
+  uint32 legal = 0;
+  bool found = false;
+
+  self->visited++;
+  if (depth == 0)
+  {
+    return expectimax_evaluate(self, b);
+  }
+  if (probability < self->cutoff && best == NULL)
+  {
+    self->pruned++;
+    self->cut++;
+    return expectimax_evaluate(self, b);
+  }
+
+  legal = calculator_legal_moves(self->bc, b);
+  for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+  {
+    if ((legal & CALCULATOR_MOVE_BIT(dir)) == 0)
+    {
+      continue;
+    }
+    calculator_move_with_hash(self->bc, b, hash, &next, &next_hash, dir);
+    child = expectimax_chance(self, next, next_hash, depth - 1, probability);
+    if (found == false || child > value)
+    {
+      found = true;
+      value = child;
+      if (best != NULL)
+      {
+        *best = dir;
+      }
+    }
+  }
+
+  return value;
+}
+
+/*
+ * Every spawn of GAME_NUBMER_ELEMENTS is as likely as the others, as
+ * game.c picks them, on every empty cell alike.
+ */
+static int32 expectimax_chance(expectimax *self, bitboard b, uint64 hash,
+  uint32 depth, float probability)
+{
+  uint8 cells[BITBOARD_CELLS];
+  uint32 values[] = GAME_NUBMER_ELEMENTS;
+  uint32 exps[ARRAY_SIZE(values)];
+  bitboard leaves[BITBOARD_CELLS * ARRAY_SIZE(values)];
+  int32 scores[BITBOARD_CELLS * ARRAY_SIZE(values)];
+  uint32 len = 0, count = 0, i = 0, j = 0, cell = 0;
+  uint64 cut = self->cut;
+  int64 sum = 0;
+  int32 value = 0;
+  float spawn = 0;
+  const ttable_entry *entry = NULL;
+
+  self->visited++;
+  if (depth == 0)
+  {
+    return expectimax_evaluate(self, b);
+  }
+
+  entry = ttable_probe(self->tt, hash, b, COMPUTER_TURN);
+  if (entry != NULL && entry->depth >= depth)
+  {
+    return entry->value;
+  }
+
+  len = bitboard_get_empty(b, cells);
+  if (len == 0)
+  {
+    return expectimax_evaluate(self, b);
+  }
+  count = (self->sample != 0 && len > self->sample) ? self->sample : len;
+  self->pruned += (uint64)(len - count) * ARRAY_SIZE(values);
+  spawn = probability / (float)(count * ARRAY_SIZE(values));
+  for (j = 0; j < ARRAY_SIZE(values); j++)
+  {
+    exps[j] = bitboard_value_to_exponent(values[j]);
+  }
+
+  /* the spawned boards are all leaves here, score them in one call */
+  if (depth == 1)
+  {
+    for (i = 0; i < count; i++)
+    {
+      cell = cells[i * len / count];
+      for (j = 0; j < ARRAY_SIZE(values); j++)
+      {
+        leaves[i * ARRAY_SIZE(values) + j] = bitboard_set_cell(b, cell,
+          exps[j]);
+      }
+    }
+    expectimax_evaluate_batch(self, leaves, count * ARRAY_SIZE(values),
+      scores);
+    self->visited += count * ARRAY_SIZE(values);
+    for (i = 0; i < count * ARRAY_SIZE(values); i++)
+    {
+      sum += scores[i];
+    }
+  }
+  else
+  {
+    for (i = 0; i < count; i++)
+    {
+      cell = cells[i * len / count];
+      for (j = 0; j < ARRAY_SIZE(values); j++)
+      {
+        sum += expectimax_player(self, bitboard_set_cell(b, cell, exps[j]),
+          hash ^ bitboard_hash_key(cell, exps[j]), depth - 1, spawn, NULL);
+      }
+    }
+  }
+  value = (int32)(sum / (int64)(count * ARRAY_SIZE(values)));
+  /*
+   * A value with cut off nodes below only holds as likely as this path,
+   * a likelier one reaching the board must search it again.
+   */
+  if (self->cut == cut)
+  {
+    ttable_store(self->tt, hash, b, COMPUTER_TURN, depth, value,
+      TTABLE_EXACT, BOTTOM_OF_DIRECTION);
+  }
+
+  return value;
+}
+
+static int32 expectimax_evaluate(expectimax *self, bitboard b)
+{
+  if (self->nt != NULL)
+  {
+    return ntuple_get_value(self->nt, b);
+  }
+
+  return evaluator_get_value(self->be, b);
+}
+
+static void expectimax_evaluate_batch(expectimax *self, const bitboard *boards,
+  uint32 len, int32 *values)
+{
+  if (self->nt != NULL)
+  {
+    ntuple_get_values(self->nt, boards, len, values);
+  }
+  else
+  {
+    evaluator_get_values(self->be, boards, len, values);
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef __EXPECTIMAX_H__
+#define __EXPECTIMAX_H__
+
+#include "constants.h"
+#include "../models/bitboard.h"
+
+/*
+ * Expectimax search: the computer spawns at random rather than at its
+ * worst, so chance nodes average their spawns.  The search runs depth
+ * first and keeps no tree; depth counts levels as minmax_search does.
+ */
+typedef struct _expectimax expectimax;
+
+bool expectimax_create(expectimax **self);
+void expectimax_destory(expectimax **self);
+bool expectimax_load_weights(expectimax *self, const char *path);
+void expectimax_set_weights(expectimax *self, float smoothness,
+  float monotonicity, float empty, float max_value);
+bool expectimax_set_table_size(expectimax *self, uint32 megabytes);
+void expectimax_set_cutoff(expectimax *self, float probability);
+void expectimax_set_sample(expectimax *self, uint32 cells);
+void expectimax_get_stats(expectimax *self, uint64 *visited, uint64 *pruned);
+void expectimax_get_table_stats(expectimax *self, uint64 *hits,
+  uint64 *misses, uint64 *collisions);
+enum direction expectimax_search(expectimax *self, bitboard b, uint32 depth);
+
+#endif /* __EXPECTIMAX_H__ */
@@ -1,30 +1,83 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include "minmax.h"
 #include "../models/calculator.h"
 #include "tree.h"
 #include "board_pool.h"
 #include "evaluator.h"
+#include "ntuple.h"
+#include "ttable.h"
 #include "../views/output.h"
 
+/* player leaves moved together by calculator_move_batch */
+#define MINMAX_BATCH  64
+
+/* tree modes grow no further once the tree holds this many nodes */
+#define MINMAX_TREE_NODES   (1 << 16)
+
+/* the most leaves one best first search grows */
+#define MINMAX_EXPANSIONS   (1 << 12)
+
+/* the most spawns a computer node can have */
+#define MINMAX_SPAWNS (BITBOARD_CELLS * 2)
+
 typedef struct _minmax
 {
   tree        *bt;
   board_pool  *bp;
   evaluator   *be;
   calculator  *bc;
+  ntuple      *nt;          /* values the leaves instead of be when loaded */
+  ttable      *tt;          /* NULL when sized to 0MB */
+  enum minmax_mode  mode;
+  bitboard    last;         /* last board searched depth first */
+  uint32      board_sym;    /* searched board -> canonical form */
+  uint32      root_sym;     /* root node board -> canonical form */
+  uint64      visited;      /* nodes the last search reached */
+  uint64      pruned;       /* children it cut off */
+  uint32      history[BOTTOM_OF_DIRECTION];           /* cutoffs per move */
+  enum direction  killers[MAX_SEARCH_DEPTH + 1];     /* per depth left */
 } minmax;
 
 #define MIN(a, b)   (((a) <= (b)) ? (a) : (b))
 
-static bool minmax_change_tree_root(minmax *self, board *b,
-  enum direction last_dir);
+/* start values of player and computer nodes, beyond any evaluation */
+#define MINMAX_LOSS   (-EVALUATOR_MAX - 1)
+#define MINMAX_WIN    (EVALUATOR_MAX + 1)
+
+/* best first: a child nothing was grown below gets this share of the
+ * spread of its siblings' values as a bonus */
+#define MINMAX_EXPLORE  4
+
+static bool minmax_change_tree_root(minmax *self, bitboard b);
 static void minmax_growth_tree(minmax *self);
-static void minmax_new_level(minmax *self, tree_node *node);
-static void minmax_new_level_for_player(minmax *self, tree_node *node,
-  board_data *bd);
+static void minmax_new_level_for_players(minmax *self, tree_node **nodes,
+  uint32 len);
 static void minmax_new_level_for_computer(minmax *self, tree_node *node,
   board_data *bd);
-static double minmax_search_engine(minmax *self, uint32 depth, tree_node *root);
+static uint32 minmax_worst_spawns(minmax *self, bitboard b, uint8 *cells,
+  uint8 *exps);
+static int32 minmax_evaluate(minmax *self, bitboard b);
+static void minmax_evaluate_batch(minmax *self, const bitboard *boards,
+  uint32 len, int32 *values);
+static int32 minmax_search_engine(minmax *self, uint32 depth, tree_node *root,
+  int32 alpha, int32 beta);
+static int32 minmax_depth_first(minmax *self, bitboard b, uint64 hash,
+  enum round r, uint32 depth, int32 alpha, int32 beta, enum direction *best);
+static void minmax_store(minmax *self, uint64 hash, bitboard b, enum round r,
+  uint32 depth, int32 value, int32 alpha, int32 beta, enum direction best);
+static inline uint32 minmax_move_key(minmax *self, uint32 depth,
+  enum direction pv, enum direction dir);
+static uint32 minmax_order_moves(minmax *self, uint32 depth, board_data *bd,
+  tree_node *root, tree_node **children);
+static uint32 minmax_order_directions(minmax *self, uint32 depth,
+  enum direction pv, bitboard b, uint64 hash, enum direction *dirs,
+  bitboard *next, uint64 *next_hash);
+static enum direction minmax_best_first(minmax *self, bitboard b,
+  uint32 expansions, int32 *value);
+static tree_node *minmax_select_leaf(minmax *self, tree_node *node);
+static uint32 minmax_expand_leaf(minmax *self, tree_node *node);
+static void minmax_back_up(minmax *self, tree_node *node);
 static void minmax_show_tree(minmax *self, tree_node *node);
 
 static void minmax_data_free_callback(void *owner, void *data)
@@ -36,19 +89,40 @@ static void minmax_data_free_callback(void *owner, void *data)
   }
 }
 
+/* a board in all its orientations, with their hashes, for tree_find_node */
+typedef struct _minmax_lookup
+{
+  bitboard    boards[BITBOARD_SYMMETRIES];
+  uint64      hashes[BITBOARD_SYMMETRIES];
+} minmax_lookup;
+
 static bool minmax_data_compare_callback(void *user_data, void *node_data)
 {
-  board_data *user_bd = (board_data *)user_data;
+  minmax_lookup *lookup = (minmax_lookup *)user_data;
   board_data *node_bd = (board_data *)node_data;
+  uint32 sym = 0;
+
+  /* any symmetric node will do; the kept hash rules out nearly all */
+  if (node_bd->r != PLAYER_TURN)
+  {
+    return false;
+  }
+  for (sym = 0; sym < BITBOARD_SYMMETRIES; sym++)
+  {
+    if (node_bd->hash == lookup->hashes[sym]
+      && bitboard_is_equal(node_bd->b, lookup->boards[sym]))
+    {
+      return true;
+    }
+  }
 
-  return board_is_equal(node_bd->b, user_bd->b)
-    && (node_bd->r == PLAYER_TURN)
-    && (node_bd->dir == user_bd->dir);
+  return false;
 }
 
 bool minmax_create(minmax **self)
 {
   bool ret = false;
+  uint32 i = 0;
 
   *self = (minmax *)malloc(sizeof(minmax));
   if (*self != NULL)
@@ -61,6 +135,20 @@ bool minmax_create(minmax **self)
     board_pool_create(&(*self)->bp);
     evaluator_create(&(*self)->be);
     calculator_create(&(*self)->bc);
+    (*self)->nt = NULL;
+    ttable_create(&(*self)->tt, TABLE_SIZE_MB);
+    (*self)->mode = MINMAX_MODE_DEPTH_FIRST;
+    (*self)->last = 0;
+    (*self)->visited = 0;
+    (*self)->pruned = 0;
+    for (i = 0; i < BOTTOM_OF_DIRECTION; i++)
+    {
+      (*self)->history[i] = 0;
+    }
+    for (i = 0; i <= MAX_SEARCH_DEPTH; i++)
+    {
+      (*self)->killers[i] = BOTTOM_OF_DIRECTION;
+    }
     ret = true;
   }
 
@@ -74,54 +162,199 @@ void minmax_destory(minmax **self)
     tree_destory(&(*self)->bt);
     board_pool_destory(&(*self)->bp);
     calculator_destory(&(*self)->bc);
+    ntuple_destory(&(*self)->nt);
+    ttable_destory(&(*self)->tt);
     free(*self);
     *self = NULL;
   }
 }
 
-enum direction minmax_search(minmax *self, board *b, enum direction last_dir,
-  uint32 depth)
+/*
+ * Value the search leaves with the n-tuple network in path from now on.
+ * Spawns are still picked by the evaluator heuristic.  The tree is
+ * dropped since its values came from the other evaluator.
+ */
+bool minmax_load_weights(minmax *self, const char *path)
+{
+  bool ret = false;
+  ntuple *nt = NULL;
+
+  if (self != NULL && path != NULL)
+  {
+    if (ntuple_load(&nt, path) == true)
+    {
+      ntuple_destory(&self->nt);
+      self->nt = nt;
+      tree_delete(self->bt, tree_get_root(self->bt));
+      ttable_clear(self->tt);
+      ret = true;
+    }
+  }
+
+  return ret;
+}
+
+/* heuristic weights, see evaluator.h; the tree holds stale values after */
+void minmax_set_weights(minmax *self, float smoothness, float monotonicity,
+  float empty, float max_value)
+{
+  if (self != NULL)
+  {
+    evaluator_set_smoothness_weight(self->be, smoothness);
+    evaluator_set_monotonicity_weight(self->be, monotonicity);
+    evaluator_set_empty_weight(self->be, empty);
+    evaluator_set_max_value_weight(self->be, max_value);
+    tree_delete(self->bt, tree_get_root(self->bt));
+    ttable_clear(self->tt);
+  }
+}
+
+/* a new transposition table of megabytes, none for 0 */
+bool minmax_set_table_size(minmax *self, uint32 megabytes)
+{
+  bool ret = false;
+  ttable *tt = NULL;
+
+  if (self != NULL)
+  {
+    if (megabytes == 0)
+    {
+      ttable_destory(&self->tt);
+      ret = true;
+    }
+    else if (ttable_create(&tt, megabytes) == true)
+    {
+      ttable_destory(&self->tt);
+      self->tt = tt;
+      ret = true;
+    }
+  }
+
+  return ret;
+}
+
+/* switching drops the tree, a depth first search has no use for it */
+bool minmax_set_mode(minmax *self, enum minmax_mode mode)
+{
+  bool ret = false;
+
+  if (self != NULL && mode < BOTTOM_OF_MINMAX_MODE)
+  {
+    if (mode != self->mode)
+    {
+      tree_delete(self->bt, tree_get_root(self->bt));
+      self->mode = mode;
+    }
+    ret = true;
+  }
+
+  return ret;
+}
+
+/* transposition table counts of the last minmax_search */
+void minmax_get_table_stats(minmax *self, uint64 *hits, uint64 *misses,
+  uint64 *collisions)
+{
+  *hits = 0;
+  *misses = 0;
+  *collisions = 0;
+  if (self != NULL)
+  {
+    ttable_get_stats(self->tt, hits, misses, collisions);
+  }
+}
+
+/* node counts of the last minmax_search */
+void minmax_get_stats(minmax *self, uint64 *visited, uint64 *pruned)
+{
+  if (self != NULL)
+  {
+    *visited = self->visited;
+    *pruned = self->pruned;
+  }
+}
+
+enum direction minmax_search(minmax *self, bitboard b, uint32 depth)
+{
+  int32 value = 0;
+
+  return minmax_search_window(self, b, depth, INT32_MIN, INT32_MAX, &value);
+}
+
+/*
+ * Search b with the window alpha, beta.  When *value comes back at or
+ * outside the window it is only a bound, and the move should not be
+ * trusted; search again with a wider window.  Best first ignores the
+ * window and grows 2^depth leaves, at most MINMAX_EXPANSIONS and short of
+ * MINMAX_TREE_NODES; *value is then exact.
+ */
+enum direction minmax_search_window(minmax *self, bitboard b, uint32 depth,
+  int32 alpha, int32 beta, int32 *value)
 {
   enum direction best = BOTTOM_OF_DIRECTION;
-  double best_value = 0.0;
+  int32 best_value = 0;
   uint32 tree_depth = 0;
   uint32 i = 0;
   tree_node *root = NULL;
+  board_data *bd = NULL;
 
-  if (self != NULL && b != NULL && depth != 0)
+  if (self != NULL && depth != 0)
   {
-    if (minmax_change_tree_root(self, b, last_dir) == true)
+    depth = MIN(depth, MAX_SEARCH_DEPTH);
+    self->visited = 0;
+    self->pruned = 0;
+    ttable_reset_stats(self->tt);
+    /* older cutoffs count for less */
+    for (i = 0; i < BOTTOM_OF_DIRECTION; i++)
+    {
+      self->history[i] >>= 1;
+    }
+    if (self->mode == MINMAX_MODE_DEPTH_FIRST)
     {
-      tree_depth = tree_get_depth(self->bt);
-      if (depth > tree_depth)
+      if (b != self->last)
       {
-        for (i = 0; i < depth - tree_depth; i++)
-        {
-          minmax_growth_tree(self);
-          //LOG("tree depth is %u", tree_get_depth(self->bt));
-        }
+        ttable_new_generation(self->tt);
+        self->last = b;
+      }
+      *value = minmax_depth_first(self, b, bitboard_hash(b), PLAYER_TURN,
+        depth - 1, alpha, beta, &best);
+    }
+    else if (self->mode == MINMAX_MODE_BEST_FIRST)
+    {
+      best = minmax_best_first(self, b,
+        MIN((uint32)1 << depth, MINMAX_EXPANSIONS), value);
+    }
+    else if (minmax_change_tree_root(self, b) == true)
+    {
+      /*
+       * Whole levels only, so every leaf sits at the same depth; none past
+       * MINMAX_TREE_NODES, as the next one may be many times bigger.
+       */
+      for (tree_depth = tree_get_depth(self->bt); tree_depth < depth
+        && tree_get_size(self->bt) < MINMAX_TREE_NODES; tree_depth++)
+      {
+        minmax_growth_tree(self);
+        //LOG("tree depth is %u", tree_get_depth(self->bt));
       }
       root = tree_get_root(self->bt);
       depth = MIN(depth, tree_get_depth(self->bt));
       //LOG("search depth is %u", depth);
       if (root != NULL)
       {
-        best_value = minmax_search_engine(self, depth - 1, root);
-        //LOG("best value is %.13f", best_value);
+        best_value = minmax_search_engine(self, depth - 1, root, alpha, beta);
+        *value = best_value;
+        //LOG("best value is %d", best_value);
         //LOG("*************** show the tree begin .***********************");
         //minmax_show_tree(self, NULL);
         //LOG("*************** show the tree end .***********************");
-        tree_node *child_node = tree_get_child(self->bt, root);
-        while (child_node != NULL)
+        /* the children are searched out of order, so ask the root */
+        bd = tree_get_data(self->bt, root);
+        if (tree_get_child(self->bt, root) != NULL
+          && bd->best < BOTTOM_OF_DIRECTION)
         {
-          board_data *bd = tree_get_data(self->bt, child_node);
-          //LOG("bd value is %.13f, dir is %u", bd->value, bd->dir);
-          if (bd->value == best_value)
-          {
-            best = bd->dir;
-            break;
-          }
-          child_node = tree_get_sibling(self->bt, child_node);
+          /* from the root frame through the canonical one to b */
+          best = bitboard_symmetry_direction_back(self->board_sym,
+            bitboard_symmetry_direction(self->root_sym, bd->best));
         }
       }
     }
@@ -130,16 +363,24 @@ enum direction minmax_search(minmax *self, board *b, enum direction last_dir,
   return best;
 }
 
-static bool minmax_change_tree_root(minmax *self, board *b,
-  enum direction last_dir)
+/*
+ * Subtrees are looked up by canonical board, so a position reached in any
+ * of its eight orientations is reused.  The root keeps the orientation it
+ * was grown in; board_sym and root_sym translate its moves back to b.
+ */
+static bool minmax_change_tree_root(minmax *self, bitboard b)
 {
   bool ret = false;
   board_data *bd = NULL;
+  minmax_lookup lookup;
+  uint32 sym = 0;
 
   bd = board_pool_get(self->bp);
   if (bd != NULL)
   {
-    board_clone_data(bd->b, b);
+    bd->b = bitboard_canonical(b, &self->board_sym);
+    bd->hash = bitboard_hash(bd->b);
+    self->root_sym = 0;
     tree_node *current_root = NULL;
     current_root = tree_get_root(self->bt);
     if (current_root == NULL)
@@ -150,13 +391,20 @@ static bool minmax_change_tree_root(minmax *self, board *b,
     }
     else
     {
-      bd->dir = last_dir;
-      tree_node *node = tree_find_node(self->bt, (void *)bd);
+      for (sym = 0; sym < BITBOARD_SYMMETRIES; sym++)
+      {
+        lookup.boards[sym] = bitboard_apply_symmetry(b, sym);
+        lookup.hashes[sym] = bitboard_hash(lookup.boards[sym]);
+      }
+      tree_node *node = tree_find_node(self->bt, (void *)&lookup);
       if (node != NULL)
       {
+        bitboard_canonical(((board_data *)tree_get_data(self->bt, node))->b,
+          &self->root_sym);
         if (node != current_root)
         {
           tree_set_new_root(self->bt, node);
+          ttable_new_generation(self->tt);
           //LOG("change root from %p to %p", current_root, node);
         }
         board_pool_put(self->bp, bd);
@@ -167,6 +415,7 @@ static bool minmax_change_tree_root(minmax *self, board *b,
         bd->r = PLAYER_TURN;
         tree_delete(self->bt, current_root);
         tree_insert(self->bt, NULL, (void *)bd);
+        ttable_new_generation(self->tt);
         //LOG("change root from %p to %p", current_root, tree_get_root(self->bt));
       }
     }
@@ -176,160 +425,762 @@ static bool minmax_change_tree_root(minmax *self, board *b,
   return ret;
 }
 
+/*
+ * Leaves are expanded level-wise: computer leaves one by one, player leaves
+ * gathered into batches so that each direction is a single batched move.
+ */
 static void minmax_growth_tree(minmax *self)
 {
   tree_node *leaf = NULL;
+  tree_node *nodes[MINMAX_BATCH];
+  uint32 len = 0;
+  board_data *bd = NULL;
 
   leaf = tree_get_first_leaf(self->bt);
   while (leaf != NULL)
   {
-    minmax_new_level(self, leaf);
+    bd = tree_get_data(self->bt, leaf);
+    if (bd != NULL)
+    {
+      switch (bd->r)
+      {
+        case PLAYER_TURN:
+          nodes[len++] = leaf;
+          if (len == MINMAX_BATCH)
+          {
+            minmax_new_level_for_players(self, nodes, len);
+            len = 0;
+          }
+          break;
+        case COMPUTER_TURN:
+          minmax_new_level_for_computer(self, leaf, bd);
+          break;
+        default:
+          break;
+      }
+    }
     leaf = tree_get_next_leaf(self->bt);
   }
+  if (len != 0)
+  {
+    minmax_new_level_for_players(self, nodes, len);
+  }
 }
 
-static void minmax_new_level(minmax *self, tree_node *node)
+static void minmax_new_level_for_players(minmax *self, tree_node **nodes,
+  uint32 len)
 {
-  board_data *bd = NULL;
+  enum direction dir = BOTTOM_OF_DIRECTION;
+  bitboard in[MINMAX_BATCH];
+  bitboard out[BOTTOM_OF_DIRECTION][MINMAX_BATCH];
+  uint64 changed[BOTTOM_OF_DIRECTION];
+  board_data *bd = NULL, *new_bd = NULL;
+  uint32 i = 0, legal = 0;
 
-  bd = tree_get_data(self->bt, node);
-  if (bd != NULL)
+  for (i = 0; i < len; i++)
   {
-    switch (bd->r)
+    in[i] = ((board_data *)tree_get_data(self->bt, nodes[i]))->b;
+    legal |= calculator_legal_moves(self->bc, in[i]);
+  }
+  /* a direction no board in the batch can take is not worth a pass */
+  for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+  {
+    if ((legal & CALCULATOR_MOVE_BIT(dir)) == 0)
     {
-      case PLAYER_TURN:
-        minmax_new_level_for_player(self, node, bd);
-        break;
-      case COMPUTER_TURN:
-        minmax_new_level_for_computer(self, node, bd);
-        break;
-      default:
-        break;
+      changed[dir] = 0;
+      continue;
+    }
+    calculator_move_batch(self->bc, in, out[dir], len, dir, &changed[dir]);
+  }
+
+  /* children keep the UP, DOWN, LEFT, RIGHT order of the single moves */
+  for (i = 0; i < len; i++)
+  {
+    bd = tree_get_data(self->bt, nodes[i]);
+    for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+    {
+      if ((changed[dir] & ((uint64)1 << i)) == 0)
+      {
+        continue;
+      }
+      new_bd = board_pool_get(self->bp);
+      if (new_bd != NULL)
+      {
+        new_bd->b = out[dir][i];
+        new_bd->hash = bitboard_hash_update(bd->hash, bd->b, new_bd->b);
+        new_bd->dir = dir;
+        new_bd->r = COMPUTER_TURN;
+        tree_insert(self->bt, nodes[i], (void *)new_bd);
+      }
     }
   }
 }
 
-static void minmax_new_level_for_player(minmax *self, tree_node *node,
+static void minmax_new_level_for_computer(minmax *self, tree_node *node,
   board_data *bd)
 {
-  enum direction dir = BOTTOM_OF_DIRECTION;
+  uint8 cells[MINMAX_SPAWNS], exps[MINMAX_SPAWNS];
+  uint32 len = 0, i = 0;
   board_data *new_bd = NULL;
 
-  for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+  len = minmax_worst_spawns(self, bd->b, cells, exps);
+  for (i = 0; i < len; i++)
   {
     new_bd = board_pool_get(self->bp);
-    if (new_bd != NULL)
+    if (new_bd == NULL)
     {
-      if (calculator_move(self->bc, bd->b, new_bd->b, dir) == true)
+      return;
+    }
+    new_bd->r = PLAYER_TURN;
+    new_bd->dir = bd->dir;
+    new_bd->b = bitboard_set_cell(bd->b, cells[i], exps[i]);
+    new_bd->hash = bd->hash ^ bitboard_hash_key(cells[i], exps[i]);
+    tree_insert(self->bt, node, (void *)new_bd);
+  }
+}
+
+/*
+ * The computer is taken to spawn where the board gets least smooth and
+ * most broken up; every spawn tied for that is a child, so the search has
+ * a choice to make at computer nodes as well.  Returns how many, as cell
+ * and exponent pairs.
+ */
+static uint32 minmax_worst_spawns(minmax *self, bitboard b, uint8 *cells,
+  uint8 *exps)
+{
+  uint8 empty[BITBOARD_CELLS];
+  uint32 len = 0, count = 0;
+  uint32 i = 0, j = 0;
+  uint32 values[] = GAME_NUBMER_ELEMENTS;
+  int32 smoothness[ARRAY_SIZE(values)][BITBOARD_CELLS];
+  int32 islands[ARRAY_SIZE(values)][BITBOARD_CELLS];
+  int32 scores[ARRAY_SIZE(values)][BITBOARD_CELLS];
+  int32 worst_score = INT32_MIN;
+  uint32 x = 0, y = 0, cell = 0;
+
+  /*
+   * -smoothness + islands of every candidate differs from the parent's by
+   * the spawn deltas alone, so those rank the candidates.
+   */
+  for (j = 0; j < ARRAY_SIZE(values); j++)
+  {
+    evaluator_spawn_deltas(self->be, b,
+      bitboard_value_to_exponent(values[j]), smoothness[j], islands[j]);
+  }
+
+  /* walk the empty cells column by column, as board_get_empty does */
+  len = bitboard_get_empty(bitboard_transpose(b), empty);
+  for (i = 0; i < len; i++)
+  {
+    x = empty[i] / BITBOARD_ROWS;
+    y = empty[i] % BITBOARD_ROWS;
+    cell = y * BITBOARD_COLS + x;
+    for (j = 0; j < ARRAY_SIZE(values); j++)
+    {
+      scores[j][cell] = -smoothness[j][cell] + islands[j][cell];
+      if (worst_score < scores[j][cell])
       {
-        new_bd->dir = dir;
-        new_bd->r = COMPUTER_TURN;
-        //new_bd->value = evaluator_get_value(self->be, new_bd->b);
-        tree_insert(self->bt, node, (void *)new_bd);
+        worst_score = scores[j][cell];
       }
-      else
+    }
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    x = empty[i] / BITBOARD_ROWS;
+    y = empty[i] % BITBOARD_ROWS;
+    cell = y * BITBOARD_COLS + x;
+    for (j = 0; j < ARRAY_SIZE(values); j++)
+    {
+      if (scores[j][cell] == worst_score)
       {
-        board_pool_put(self->bp, new_bd);
+        cells[count] = (uint8)cell;
+        exps[count] = (uint8)bitboard_value_to_exponent(values[j]);
+        count++;
       }
     }
   }
+
+  return count;
 }
 
-static void minmax_new_level_for_computer(minmax *self, tree_node *node,
-  board_data *bd)
+static int32 minmax_evaluate(minmax *self, bitboard b)
 {
-  uint64 *pos_array = NULL;
-  uint32 len = 0;
-  uint32 i = 0, j = 0;
-  board_data *new_bd = NULL;
-  uint32 values[] = GAME_NUBMER_ELEMENTS;
-  uint32 islands = 0;
-  int32 smoothness = 0, worst_score = INT32_MIN;
-  uint64 worst_pos = 0;
-  uint32 worst_val = values[0];
+  if (self->nt != NULL)
+  {
+    return ntuple_get_value(self->nt, b);
+  }
+
+  return evaluator_get_value(self->be, b);
+}
+
+/* the values of a node's leaf children, scored in one call */
+static void minmax_evaluate_batch(minmax *self, const bitboard *boards,
+  uint32 len, int32 *values)
+{
+  if (self->nt != NULL)
+  {
+    ntuple_get_values(self->nt, boards, len, values);
+  }
+  else
+  {
+    evaluator_get_values(self->be, boards, len, values);
+  }
+}
+
+/*
+ * Alpha-beta over the grown tree, fail-soft: a value at or below alpha, or
+ * at or above beta, is only a bound.  Leaves are evaluated when reached,
+ * so cut off subtrees cost nothing.  Each node keeps the window it was
+ * searched with next to its value.  Results go to the transposition
+ * table, and below the root a deep enough entry ends the search there.
+ */
+static int32 minmax_search_engine(minmax *self, uint32 depth, tree_node *root,
+  int32 alpha, int32 beta)
+{
+  int32 value = 0;
+  board_data *bd = NULL, *child_bd = NULL;
+  tree_node *child_node = NULL;
+  tree_node *children[BOTTOM_OF_DIRECTION];
+  uint32 len = 0, i = 0;
+  int32 alpha0 = alpha, beta0 = beta;
+  const ttable_entry *entry = NULL;
+
+  bd = tree_get_data(self->bt, root);
+  if (bd == NULL)
+  {
+    return value;
+  }
+
+  self->visited++;
+  bd->alpha = alpha;
+  bd->beta = beta;
+  if (depth == 0)
+  {
+    bd->value = minmax_evaluate(self, bd->b);
+    return bd->value;
+  }
+
+  entry = ttable_probe(self->tt, bd->hash, bd->b, bd->r);
+  if (entry != NULL)
+  {
+    if (bd->best == BOTTOM_OF_DIRECTION)
+    {
+      bd->best = (enum direction)entry->best;
+    }
+    if (entry->depth >= depth && root != tree_get_root(self->bt)
+      && (entry->bound == TTABLE_EXACT
+      || (entry->bound == TTABLE_LOWER && entry->value >= beta)
+      || (entry->bound == TTABLE_UPPER && entry->value <= alpha)))
+    {
+      bd->value = entry->value;
+      return bd->value;
+    }
+  }
 
-  board_get_empty(bd->b, &pos_array, &len);
-  new_bd = board_pool_get(self->bp);
-  if (new_bd != NULL)
+  if (bd->r == PLAYER_TURN)
   {
+    bd->value = MINMAX_LOSS;
+    len = minmax_order_moves(self, depth, bd, root, children);
     for (i = 0; i < len; i++)
     {
-      for (j = 0; j < ARRAY_SIZE(values); j++)
+      child_bd = tree_get_data(self->bt, children[i]);
+      value = minmax_search_engine(self, depth - 1, children[i], alpha, beta);
+      if (i == 0 || value > bd->value)
       {
-        board_clone_data(new_bd->b, bd->b);
-        board_set_value_by_pos(new_bd->b, pos_array[i], values[j]);
-        smoothness = evaluator_smoothness(self->be, new_bd->b);
-        islands = evaluator_islands(self->be, new_bd->b);
-        if (worst_score < (int32)(-smoothness + islands))
-        {
-          worst_score = (int32)(-smoothness + islands);
-          worst_pos = pos_array[i];
-          worst_val = values[j];
-        }
+        bd->value = value;
+        bd->best = child_bd->dir;
+      }
+      if (value > alpha)
+      {
+        alpha = value;
+      }
+      if (alpha >= beta)
+      {
+        self->history[child_bd->dir] += depth * depth;
+        self->killers[depth] = child_bd->dir;
+        self->pruned += len - i - 1;
+        break;
+      }
+    }
+    minmax_store(self, bd->hash, bd->b, bd->r, depth, bd->value, alpha0,
+      beta0, bd->best);
+    return bd->value;
+  }
+
+  bd->value = MINMAX_WIN;
+  child_node = tree_get_child(self->bt, root);
+  while (child_node != NULL)
+  {
+    value = minmax_search_engine(self, depth - 1, child_node, alpha, beta);
+    if (value < bd->value)
+    {
+      bd->value = value;
+    }
+    if (value < beta)
+    {
+      beta = value;
+    }
+    child_node = tree_get_sibling(self->bt, child_node);
+    if (alpha >= beta)
+    {
+      while (child_node != NULL)
+      {
+        self->pruned++;
+        child_node = tree_get_sibling(self->bt, child_node);
       }
     }
-    new_bd->r = PLAYER_TURN;
-    new_bd->dir = bd->dir;
-    board_clone_data(new_bd->b, bd->b);
-    board_set_value_by_pos(new_bd->b, worst_pos, worst_val);
-    //new_bd->value = evaluator_get_value(self->be, new_bd->b);
-    tree_insert(self->bt, node, (void *)new_bd);
   }
-  free(pos_array);
+  minmax_store(self, bd->hash, bd->b, bd->r, depth, bd->value, alpha0, beta0,
+    BOTTOM_OF_DIRECTION);
+
+  return bd->value;
 }
 
-static double minmax_search_engine(minmax *self, uint32 depth, tree_node *root)
+/*
+ * The same search as minmax_search_engine without the tree: children are
+ * made on the stack as they are searched and dropped after, so memory
+ * stays O(depth).  The table's move stands in for the one a tree node
+ * would keep from the last search.
+ */
+static int32 minmax_depth_first(minmax *self, bitboard b, uint64 hash,
+  enum round r, uint32 depth, int32 alpha, int32 beta, enum direction *best)
+{
+  int32 value = 0, child = 0;
+  int32 alpha0 = alpha, beta0 = beta;
+  const ttable_entry *entry = NULL;
+  enum direction pv = BOTTOM_OF_DIRECTION, found = BOTTOM_OF_DIRECTION;
+  enum direction dirs[BOTTOM_OF_DIRECTION];
+  bitboard next[BOTTOM_OF_DIRECTION];
+  uint64 next_hash[BOTTOM_OF_DIRECTION];
+  uint8 cells[MINMAX_SPAWNS], exps[MINMAX_SPAWNS];
+  bitboard spawned[MINMAX_SPAWNS];
+  int32 leaves[MINMAX_SPAWNS];
+  uint32 len = 0, i = 0;
+
+  self->visited++;
+  if (depth == 0)
+  {
+    return minmax_evaluate(self, b);
+  }
+
+  entry = ttable_probe(self->tt, hash, b, r);
+  if (entry != NULL)
+  {
+    pv = (enum direction)entry->best;
+    if (entry->depth >= depth && best == NULL
+      && (entry->bound == TTABLE_EXACT
+      || (entry->bound == TTABLE_LOWER && entry->value >= beta)
+      || (entry->bound == TTABLE_UPPER && entry->value <= alpha)))
+    {
+      return entry->value;
+    }
+  }
+
+  if (r == PLAYER_TURN)
+  {
+    value = MINMAX_LOSS;
+    len = minmax_order_directions(self, depth, pv, b, hash, dirs, next,
+      next_hash);
+    if (depth == 1)
+    {
+      minmax_evaluate_batch(self, next, len, leaves);
+    }
+    for (i = 0; i < len; i++)
+    {
+      if (depth == 1)
+      {
+        self->visited++;
+        child = leaves[i];
+      }
+      else
+      {
+        child = minmax_depth_first(self, next[i], next_hash[i], COMPUTER_TURN,
+          depth - 1, alpha, beta, NULL);
+      }
+      if (i == 0 || child > value)
+      {
+        value = child;
+        found = dirs[i];
+      }
+      if (child > alpha)
+      {
+        alpha = child;
+      }
+      if (alpha >= beta)
+      {
+        self->history[dirs[i]] += depth * depth;
+        self->killers[depth] = dirs[i];
+        self->pruned += len - i - 1;
+        break;
+      }
+    }
+    if (best != NULL)
+    {
+      *best = found;
+    }
+  }
+  else
+  {
+    value = MINMAX_WIN;
+    len = minmax_worst_spawns(self, b, cells, exps);
+    for (i = 0; i < len; i++)
+    {
+      spawned[i] = bitboard_set_cell(b, cells[i], exps[i]);
+    }
+    if (depth == 1)
+    {
+      minmax_evaluate_batch(self, spawned, len, leaves);
+    }
+    for (i = 0; i < len; i++)
+    {
+      if (depth == 1)
+      {
+        self->visited++;
+        child = leaves[i];
+      }
+      else
+      {
+        child = minmax_depth_first(self, spawned[i],
+          hash ^ bitboard_hash_key(cells[i], exps[i]), PLAYER_TURN,
+          depth - 1, alpha, beta, NULL);
+      }
+      if (child < value)
+      {
+        value = child;
+      }
+      if (child < beta)
+      {
+        beta = child;
+      }
+      if (alpha >= beta)
+      {
+        self->pruned += len - i - 1;
+        break;
+      }
+    }
+  }
+  minmax_store(self, hash, b, r, depth, value, alpha0, beta0, found);
+
+  return value;
+}
+
+/* a value as searched with the window alpha, beta */
+static void minmax_store(minmax *self, uint64 hash, bitboard b, enum round r,
+  uint32 depth, int32 value, int32 alpha, int32 beta, enum direction best)
+{
+  enum ttable_bound bound = TTABLE_EXACT;
+
+  if (value <= alpha)
+  {
+    bound = TTABLE_UPPER;
+  }
+  else if (value >= beta)
+  {
+    bound = TTABLE_LOWER;
+  }
+  ttable_store(self->tt, hash, b, r, depth, value, bound, best);
+}
+
+/*
+ * Player moves go best first for the cutoffs: the one the last search
+ * picked, the killer at this depth, then by history.
+ */
+static inline uint32 minmax_move_key(minmax *self, uint32 depth,
+  enum direction pv, enum direction dir)
+{
+  if (dir == pv)
+  {
+    return UINT32_MAX;
+  }
+  if (dir == self->killers[depth])
+  {
+    return UINT32_MAX - 1;
+  }
+
+  return MIN(self->history[dir], UINT32_MAX - 2);
+}
+
+/* the children of a player node in search order */
+static uint32 minmax_order_moves(minmax *self, uint32 depth, board_data *bd,
+  tree_node *root, tree_node **children)
 {
-  double value = 0.0;
-  board_data *bd = NULL;
   tree_node *child_node = NULL;
+  uint32 keys[BOTTOM_OF_DIRECTION];
+  uint32 len = 0, i = 0, key = 0;
+  enum direction dir = BOTTOM_OF_DIRECTION;
 
-  bd = tree_get_data(self->bt, root);
-  if (bd != NULL)
+  child_node = tree_get_child(self->bt, root);
+  while (child_node != NULL && len < BOTTOM_OF_DIRECTION)
   {
-    if (depth == 0)
+    dir = ((board_data *)tree_get_data(self->bt, child_node))->dir;
+    key = minmax_move_key(self, depth, bd->best, dir);
+
+    /* insertion sort, ties keep the tree order */
+    for (i = len; i > 0 && keys[i - 1] < key; i--)
     {
-      bd->value = evaluator_get_value(self->be, bd->b);
-      return bd->value;
+      keys[i] = keys[i - 1];
+      children[i] = children[i - 1];
     }
-    if (bd->r == PLAYER_TURN)
+    keys[i] = key;
+    children[i] = child_node;
+    len++;
+    child_node = tree_get_sibling(self->bt, child_node);
+  }
+
+  return len;
+}
+
+/* the legal moves of b and where they lead, in search order */
+static uint32 minmax_order_directions(minmax *self, uint32 depth,
+  enum direction pv, bitboard b, uint64 hash, enum direction *dirs,
+  bitboard *next, uint64 *next_hash)
+{
+  uint32 keys[BOTTOM_OF_DIRECTION];
+  uint32 len = 0, i = 0, key = 0;
+  enum direction dir = UP;
+  bitboard after = 0;
+  uint64 after_hash = 0;
+  uint32 legal = calculator_legal_moves(self->bc, b);
+
+  for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+  {
+    if ((legal & CALCULATOR_MOVE_BIT(dir)) == 0)
     {
-      bd->value = -10000.0;
+      continue;
     }
-    else
+    calculator_move_with_hash(self->bc, b, hash, &after, &after_hash, dir);
+    key = minmax_move_key(self, depth, pv, dir);
+
+    /* insertion sort, ties keep the UP, DOWN, LEFT, RIGHT order */
+    for (i = len; i > 0 && keys[i - 1] < key; i--)
     {
-      bd->value = 10000.0;
+      keys[i] = keys[i - 1];
+      dirs[i] = dirs[i - 1];
+      next[i] = next[i - 1];
+      next_hash[i] = next_hash[i - 1];
     }
-    child_node = tree_get_child(self->bt, root);
+    keys[i] = key;
+    dirs[i] = dir;
+    next[i] = after;
+    next_hash[i] = after_hash;
+    len++;
+  }
+
+  return len;
+}
+
+/*
+ * Best-first growth on the kept tree: rather than a level everywhere,
+ * each step follows the children the player and the computer would pick
+ * down to a leaf, grows that one leaf, and backs the new values up the
+ * path.  Node values stay exact minimax values of the tree as grown, so
+ * the effort goes to the lines the move depends on.
+ */
+static enum direction minmax_best_first(minmax *self, bitboard b,
+  uint32 expansions, int32 *value)
+{
+  enum direction best = BOTTOM_OF_DIRECTION;
+  tree_node *root = NULL, *leaf = NULL, *child_node = NULL;
+  board_data *bd = NULL, *child_bd = NULL;
+  uint32 i = 0;
+
+  if (minmax_change_tree_root(self, b) == false)
+  {
+    return best;
+  }
+  root = tree_get_root(self->bt);
+  bd = tree_get_data(self->bt, root);
+  if (bd == NULL)
+  {
+    return best;
+  }
+  /* a new root has no value yet */
+  if (bd->expansions == 0)
+  {
+    bd->value = minmax_evaluate(self, bd->b);
+  }
+
+  for (i = 0; i < expansions && bd->solved == false
+    && tree_get_size(self->bt) < MINMAX_TREE_NODES; i++)
+  {
+    leaf = minmax_select_leaf(self, root);
+    self->visited += minmax_expand_leaf(self, leaf);
+    minmax_back_up(self, leaf);
+  }
+
+  /* the root is worth its best child, the first one tied for it */
+  *value = bd->value;
+  child_node = tree_get_child(self->bt, root);
+  while (child_node != NULL && best == BOTTOM_OF_DIRECTION)
+  {
+    child_bd = tree_get_data(self->bt, child_node);
+    if (child_bd->value == bd->value)
+    {
+      best = child_bd->dir;
+    }
+    child_node = tree_get_sibling(self->bt, child_node);
+  }
+  if (best < BOTTOM_OF_DIRECTION)
+  {
+    best = bitboard_symmetry_direction_back(self->board_sym,
+      bitboard_symmetry_direction(self->root_sym, best));
+  }
+
+  return best;
+}
+
+/*
+ * Down from node to the leaf to grow.  A player takes the child of the
+ * highest value and the computer the lowest, each shifted in favour of
+ * children little was grown below.  The shift scales with how far apart
+ * the siblings' values are, so a close call gets looked at and a clear
+ * one does not.  Solved children have nothing left to grow.
+ */
+static tree_node *minmax_select_leaf(minmax *self, tree_node *node)
+{
+  tree_node *child_node = NULL, *pick = NULL;
+  board_data *bd = NULL, *child_bd = NULL;
+  int64 score = 0, pick_score = 0, bonus = 0;
+  int32 low = 0, high = 0;
+  bool first = true;
+
+  for (;;)
+  {
+    bd = tree_get_data(self->bt, node);
+    first = true;
+    child_node = tree_get_child(self->bt, node);
     while (child_node != NULL)
     {
-      value = minmax_search_engine(self, depth - 1, child_node);
-      if (bd->r == PLAYER_TURN)
+      child_bd = tree_get_data(self->bt, child_node);
+      if (child_bd->solved == false)
       {
-        if (value > bd->value)
+        if (first == true || child_bd->value < low)
+        {
+          low = child_bd->value;
+        }
+        if (first == true || child_bd->value > high)
         {
-          bd->value = value;
+          high = child_bd->value;
         }
+        first = false;
       }
-      else
+      child_node = tree_get_sibling(self->bt, child_node);
+    }
+
+    pick = NULL;
+    child_node = tree_get_child(self->bt, node);
+    while (child_node != NULL)
+    {
+      child_bd = tree_get_data(self->bt, child_node);
+      if (child_bd->solved == false)
       {
-        if (value < bd->value)
+        bonus = ((int64)high - low)
+          / (MINMAX_EXPLORE * ((int64)child_bd->expansions + 1));
+        score = (bd->r == PLAYER_TURN) ? (int64)child_bd->value + bonus
+          : bonus - (int64)child_bd->value;
+        if (pick == NULL || score > pick_score)
         {
-          bd->value = value;
+          pick = child_node;
+          pick_score = score;
         }
       }
       child_node = tree_get_sibling(self->bt, child_node);
     }
-    value = bd->value;
+    if (pick == NULL)
+    {
+      return node;
+    }
+    node = pick;
   }
+}
 
-  return value;
+/*
+ * Give a leaf its children, each valued by the evaluator.  A player leaf
+ * without a move is lost and solved.  Returns the children made.
+ */
+static uint32 minmax_expand_leaf(minmax *self, tree_node *node)
+{
+  board_data *bd = tree_get_data(self->bt, node);
+  tree_node *child_node = NULL;
+  board_data *child_bd = NULL;
+  uint32 len = 0;
+
+  if (bd->r == PLAYER_TURN)
+  {
+    minmax_new_level_for_players(self, &node, 1);
+  }
+  else
+  {
+    minmax_new_level_for_computer(self, node, bd);
+  }
+
+  child_node = tree_get_child(self->bt, node);
+  while (child_node != NULL)
+  {
+    child_bd = tree_get_data(self->bt, child_node);
+    child_bd->value = minmax_evaluate(self, child_bd->b);
+    len++;
+    child_node = tree_get_sibling(self->bt, child_node);
+  }
+  if (len == 0)
+  {
+    bd->value = MINMAX_LOSS;
+    bd->solved = true;
+  }
+
+  return len;
+}
+
+/*
+ * The values below node changed: recount it and the nodes above it, up
+ * to the first one that comes out the same.  Every node on the path
+ * counts the expansion.
+ */
+static void minmax_back_up(minmax *self, tree_node *node)
+{
+  tree_node *child_node = NULL;
+  board_data *bd = NULL, *child_bd = NULL;
+  int32 value = 0;
+  bool solved = true, changed = true;
+
+  while (node != NULL)
+  {
+    bd = tree_get_data(self->bt, node);
+    child_node = tree_get_child(self->bt, node);
+    if (changed == true && child_node != NULL)
+    {
+      value = (bd->r == PLAYER_TURN) ? MINMAX_LOSS : MINMAX_WIN;
+      solved = true;
+      while (child_node != NULL)
+      {
+        child_bd = tree_get_data(self->bt, child_node);
+        if ((bd->r == PLAYER_TURN) ? (child_bd->value > value)
+          : (child_bd->value < value))
+        {
+          value = child_bd->value;
+        }
+        if (child_bd->solved == false)
+        {
+          solved = false;
+        }
+        child_node = tree_get_sibling(self->bt, child_node);
+      }
+      changed = (value != bd->value || solved != bd->solved) ? true : false;
+      bd->value = value;
+      bd->solved = solved;
+    }
+    bd->expansions++;
+    node = tree_get_parent(self->bt, node);
+  }
 }
 
 static void minmax_show_tree(minmax *self, tree_node *node)
 {
   cout *o;
+  board *b = NULL;
   cout_create(&o);
+  board_create(&b, BITBOARD_ROWS, BITBOARD_COLS);
   tree_node *child = NULL;
   board_data *bd = NULL;
 
@@ -353,13 +1204,15 @@ static void minmax_show_tree(minmax *self, tree_node *node)
       }
       LOG("node level is %u", tree_get_node_level(self->bt, child));
       LOG("node degree is %u", tree_get_node_degree(self->bt, child));
-      LOG("node value is %.13f", bd->value);
+      LOG("node value is %d", bd->value);
       cout_display_direction(o, bd->dir);
-      cout_display_board(o, bd->b);
+      board_set_bitboard(b, bd->b);
+      cout_display_board(o, b);
     }
     minmax_show_tree(self, child);
     child = tree_get_sibling(self->bt, child);
   }
 
+  board_destory(&b);
   cout_destory(&o);
 }
@@ -2,13 +2,30 @@
 #define __MINMAX_H__
 
 #include "constants.h"
-#include "../models/board.h"
+#include "../models/bitboard.h"
 
 typedef struct _minmax minmax;
 
+enum minmax_mode
+{
+  MINMAX_MODE_DEPTH_FIRST = 0,  /* children on the stack, O(depth) memory */
+  MINMAX_MODE_TREE        = 1,  /* a tree kept between moves, for analysis */
+  MINMAX_MODE_BEST_FIRST  = 2,  /* that tree grown at its most promising leaf */
+  BOTTOM_OF_MINMAX_MODE
+};
+
 bool minmax_create(minmax **self);
 void minmax_destory(minmax **self);
-enum direction minmax_search(minmax *self, board *b, enum direction last_dir, 
-  uint32 depth);
+bool minmax_load_weights(minmax *self, const char *path);
+void minmax_set_weights(minmax *self, float smoothness, float monotonicity,
+  float empty, float max_value);
+bool minmax_set_table_size(minmax *self, uint32 megabytes);
+bool minmax_set_mode(minmax *self, enum minmax_mode mode);
+void minmax_get_stats(minmax *self, uint64 *visited, uint64 *pruned);
+void minmax_get_table_stats(minmax *self, uint64 *hits, uint64 *misses,
+  uint64 *collisions);
+enum direction minmax_search(minmax *self, bitboard b, uint32 depth);
+enum direction minmax_search_window(minmax *self, bitboard b, uint32 depth,
+  int32 alpha, int32 beta, int32 *value);
 
 #endif /* __MINMAX_H__ */
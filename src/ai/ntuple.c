@@ -0,0 +1,419 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ntuple.h"
+#include "evaluator.h"
+
+/*
+ * Weights file: this header, then the tables of the tuples in order, each
+ * 16^size native floats indexed by the exponents of the tuple cells, the
+ * first cell in the lowest nibble.  Cells are bitboard cell numbers.
+ */
+#define NTUPLE_MAGIC      0x4C50544EU   /* "NTPL" */
+#define NTUPLE_VERSION    1
+
+/* boards whose weights ntuple_get_values fetches together */
+#define NTUPLE_BATCH      8
+
+typedef struct _ntuple_header
+{
+  uint32  magic;
+  uint32  version;
+  uint32  count;
+  uint32  sizes[NTUPLE_MAX_TUPLES];
+  uint32  cells[NTUPLE_MAX_TUPLES][NTUPLE_MAX_CELLS];
+  uint32  reserved[5];
+} ntuple_header;
+
+/*
+ * The whole file image lives in map: mapped from a file by ntuple_load,
+ * or allocated by ntuple_create.  Loaded weights are a private mapping,
+ * so they may be trained further without touching the file.
+ */
+typedef struct _ntuple
+{
+  uint32  count;
+  uint32  sizes[NTUPLE_MAX_TUPLES];
+  uint32  shifts[NTUPLE_MAX_TUPLES][NTUPLE_MAX_CELLS];
+  float   *weights[NTUPLE_MAX_TUPLES];
+  void    *map;
+  size_t  map_size;
+  bool    mapped;
+} ntuple;
+
+typedef struct _ntuple_pattern
+{
+  uint32  size;
+  uint32  cells[NTUPLE_MAX_CELLS];
+} ntuple_pattern;
+
+/* rows and squares; with the symmetries they cover every line and block */
+static const ntuple_pattern ntuple_small[] =
+{
+  {4, {0, 1, 2, 3}},
+  {4, {4, 5, 6, 7}},
+  {4, {0, 1, 4, 5}},
+  {4, {1, 2, 5, 6}},
+  {4, {5, 6, 9, 10}},
+};
+
+/* the usual 2x3 and line-plus-two patterns of 4x4 n-tuple players */
+static const ntuple_pattern ntuple_large[] =
+{
+  {6, {0, 1, 2, 3, 4, 5}},
+  {6, {4, 5, 6, 7, 8, 9}},
+  {6, {0, 1, 2, 4, 5, 6}},
+  {6, {4, 5, 6, 8, 9, 10}},
+};
+
+static bool ntuple_set_layout(ntuple *self, const ntuple_header *header,
+  size_t size);
+static inline uint32 ntuple_index(const ntuple *self, bitboard b, uint32 i);
+static inline float ntuple_sum(const ntuple *self, bitboard b);
+static inline void ntuple_select(const ntuple *self, bitboard b,
+  const float **weights);
+static inline int32 ntuple_fixed(float sum);
+
+/* zero weights in one of the built-in layouts, ready for training */
+bool ntuple_create(ntuple **self, enum ntuple_layout layout)
+{
+  bool ret = false;
+  const ntuple_pattern *patterns = NULL;
+  ntuple_header *header = NULL;
+  uint32 count = 0, i = 0;
+  size_t size = sizeof(ntuple_header);
+
+  switch (layout)
+  {
+    case NTUPLE_LAYOUT_SMALL:
+      patterns = ntuple_small;
+      count = ARRAY_SIZE(ntuple_small);
+      break;
+    case NTUPLE_LAYOUT_LARGE:
+      patterns = ntuple_large;
+      count = ARRAY_SIZE(ntuple_large);
+      break;
+    default:
+      return ret;
+  }
+  for (i = 0; i < count; i++)
+  {
+    size += sizeof(float) << (patterns[i].size * BITBOARD_CELL_BITS);
+  }
+
+  *self = (ntuple *)malloc(sizeof(ntuple));
+  if (*self != NULL)
+  {
+    (*self)->mapped = false;
+    (*self)->map_size = size;
+    (*self)->map = calloc(1, size);
+    if ((*self)->map != NULL)
+    {
+      header = (ntuple_header *)(*self)->map;
+      header->magic = NTUPLE_MAGIC;
+      header->version = NTUPLE_VERSION;
+      header->count = count;
+      for (i = 0; i < count; i++)
+      {
+        header->sizes[i] = patterns[i].size;
+        memcpy(header->cells[i], patterns[i].cells, sizeof(patterns[i].cells));
+      }
+      ret = ntuple_set_layout(*self, header, size);
+    }
+    if (ret == false)
+    {
+      ntuple_destory(self);
+    }
+  }
+
+  return ret;
+}
+
+/* map the weights file, the tables are used in place */
+bool ntuple_load(ntuple **self, const char *path)
+{
+  bool ret = false;
+  struct stat st;
+  int fd = -1;
+
+  *self = (ntuple *)malloc(sizeof(ntuple));
+  if (*self == NULL)
+  {
+    return ret;
+  }
+
+  (*self)->mapped = true;
+  (*self)->map = MAP_FAILED;
+  fd = open(path, O_RDONLY);
+  if (fd >= 0)
+  {
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ntuple_header))
+    {
+      (*self)->map_size = (size_t)st.st_size;
+      (*self)->map = mmap(NULL, (*self)->map_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+  }
+
+  if ((*self)->map != MAP_FAILED)
+  {
+    ret = ntuple_set_layout(*self, (const ntuple_header *)(*self)->map,
+      (*self)->map_size);
+  }
+  if (ret == false)
+  {
+    ntuple_destory(self);
+  }
+
+  return ret;
+}
+
+void ntuple_destory(ntuple **self)
+{
+  if (*self != NULL)
+  {
+    if ((*self)->mapped == false)
+    {
+      free((*self)->map);
+    }
+    else if ((*self)->map != MAP_FAILED)
+    {
+      munmap((*self)->map, (*self)->map_size);
+    }
+    free(*self);
+    *self = NULL;
+  }
+}
+
+/*
+ * Write the file image to path through a temporary file, so a reader
+ * never maps a half written checkpoint.  Weights being trained by other
+ * threads meanwhile land in the file or not, each one whole.
+ */
+bool ntuple_save(ntuple *self, const char *path)
+{
+  bool ret = false;
+  char tmp[4096];
+  FILE *fp = NULL;
+
+  if (self == NULL || path == NULL
+    || snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+  {
+    return ret;
+  }
+
+  fp = fopen(tmp, "wb");
+  if (fp != NULL)
+  {
+    ret = (fwrite(self->map, 1, self->map_size, fp) == self->map_size)
+      ? true : false;
+    ret &= (fclose(fp) == 0) ? true : false;
+    if (ret == true)
+    {
+      ret = (rename(tmp, path) == 0) ? true : false;
+    }
+    if (ret == false)
+    {
+      unlink(tmp);
+    }
+  }
+
+  return ret;
+}
+
+int32 ntuple_get_value(ntuple *self, bitboard b)
+{
+  int32 value = 0;
+
+  if (self != NULL)
+  {
+    value = ntuple_fixed(ntuple_sum(self, b));
+  }
+
+  return value;
+}
+
+/*
+ * out[i] = ntuple_get_value(self, boards[i]) for the n boards.  The
+ * weights a group of boards selects are all requested before the first
+ * is added, so the table misses of the group overlap.  The sums run in
+ * the order of ntuple_sum and round the same.
+ */
+void ntuple_get_values(ntuple *self, const bitboard *boards, size_t n,
+  int32 *out)
+{
+  const float *weights[NTUPLE_BATCH][BITBOARD_SYMMETRIES * NTUPLE_MAX_TUPLES];
+  size_t start = 0, len = 0, k = 0, i = 0;
+  float sum = 0;
+
+  if (self == NULL || boards == NULL || out == NULL)
+  {
+    return;
+  }
+
+  for (start = 0; start < n; start += len)
+  {
+    len = (n - start < NTUPLE_BATCH) ? n - start : NTUPLE_BATCH;
+    for (k = 0; k < len; k++)
+    {
+      ntuple_select(self, boards[start + k], weights[k]);
+    }
+    for (k = 0; k < len; k++)
+    {
+      sum = 0;
+      for (i = 0; i < BITBOARD_SYMMETRIES * self->count; i++)
+      {
+        sum += *weights[k][i];
+      }
+      out[start + k] = ntuple_fixed(sum);
+    }
+  }
+}
+
+/* the value before rounding, for training */
+float ntuple_get_estimate(ntuple *self, bitboard b)
+{
+  float value = 0;
+
+  if (self != NULL)
+  {
+    value = ntuple_sum(self, b);
+  }
+
+  return value;
+}
+
+/*
+ * Move the estimate of b by delta, spread evenly over the weights b
+ * selects.  There is no locking: threads training the same tables may
+ * lose an occasional update, which is fine for stochastic gradient steps.
+ */
+void ntuple_update(ntuple *self, bitboard b, float delta)
+{
+  bitboard s = 0;
+  uint32 sym = 0, i = 0;
+
+  if (self == NULL)
+  {
+    return;
+  }
+
+  delta /= (float)(self->count * BITBOARD_SYMMETRIES);
+  for (sym = 0; sym < BITBOARD_SYMMETRIES; sym++)
+  {
+    s = bitboard_apply_symmetry(b, sym);
+    for (i = 0; i < self->count; i++)
+    {
+      self->weights[i][ntuple_index(self, s, i)] += delta;
+    }
+  }
+}
+
+/* check the header against the file size and point the tables into it */
+static bool ntuple_set_layout(ntuple *self, const ntuple_header *header,
+  size_t size)
+{
+  size_t offset = sizeof(ntuple_header);
+  uint32 i = 0, j = 0;
+
+  if (header->magic != NTUPLE_MAGIC || header->version != NTUPLE_VERSION
+    || header->count == 0 || header->count > NTUPLE_MAX_TUPLES)
+  {
+    return false;
+  }
+
+  self->count = header->count;
+  for (i = 0; i < self->count; i++)
+  {
+    self->sizes[i] = header->sizes[i];
+    if (self->sizes[i] == 0 || self->sizes[i] > NTUPLE_MAX_CELLS)
+    {
+      return false;
+    }
+    for (j = 0; j < self->sizes[i]; j++)
+    {
+      if (header->cells[i][j] >= BITBOARD_CELLS)
+      {
+        return false;
+      }
+      self->shifts[i][j] = header->cells[i][j] * BITBOARD_CELL_BITS;
+    }
+    self->weights[i] = (float *)((char *)header + offset);
+    offset += sizeof(float) << (self->sizes[i] * BITBOARD_CELL_BITS);
+  }
+
+  return (offset == size) ? true : false;
+}
+
+/* the exponents under tuple i, first cell in the lowest nibble */
+static inline uint32 ntuple_index(const ntuple *self, bitboard b, uint32 i)
+{
+  uint32 index = 0;
+  uint32 j = 0;
+
+  for (j = 0; j < self->sizes[i]; j++)
+  {
+    index |= (uint32)((b >> self->shifts[i][j]) & BITBOARD_CELL_MASK)
+      << (j * BITBOARD_CELL_BITS);
+  }
+
+  return index;
+}
+
+/* score points to 1/NTUPLE_SCALE points, saturated at EVALUATOR_MAX */
+static inline int32 ntuple_fixed(float sum)
+{
+  double value = (double)sum * NTUPLE_SCALE;
+
+  if (value >= EVALUATOR_MAX)
+  {
+    return EVALUATOR_MAX;
+  }
+  if (value <= -EVALUATOR_MAX)
+  {
+    return -EVALUATOR_MAX;
+  }
+
+  return (int32)(value + ((value >= 0) ? 0.5 : -0.5));
+}
+
+static inline float ntuple_sum(const ntuple *self, bitboard b)
+{
+  float sum = 0;
+  bitboard s = 0;
+  uint32 sym = 0, i = 0;
+
+  for (sym = 0; sym < BITBOARD_SYMMETRIES; sym++)
+  {
+    s = bitboard_apply_symmetry(b, sym);
+    for (i = 0; i < self->count; i++)
+    {
+      sum += self->weights[i][ntuple_index(self, s, i)];
+    }
+  }
+
+  return sum;
+}
+
+/* the weights ntuple_sum adds for b, in its order, fetched ahead */
+static inline void ntuple_select(const ntuple *self, bitboard b,
+  const float **weights)
+{
+  bitboard s = 0;
+  uint32 sym = 0, i = 0;
+
+  for (sym = 0; sym < BITBOARD_SYMMETRIES; sym++)
+  {
+    s = bitboard_apply_symmetry(b, sym);
+    for (i = 0; i < self->count; i++)
+    {
+      *weights = &self->weights[i][ntuple_index(self, s, i)];
+      __builtin_prefetch(*weights++);
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef __NTUPLE_H__
+#define __NTUPLE_H__
+
+#include "constants.h"
+#include "../models/bitboard.h"
+
+/*
+ * N-tuple network: a handful of cell patterns, each with a table holding
+ * one weight per combination of exponents on its cells.  A board is worth
+ * the sum of the weights its patterns select, over all eight symmetries.
+ * Estimates are score points; ntuple_get_value gives them in steps of
+ * 1/NTUPLE_SCALE point, saturated at EVALUATOR_MAX like the evaluator's
+ * values, so either can value the search leaves.
+ */
+typedef struct _ntuple ntuple;
+
+/* 1/16 point steps reach past 67 million points before saturating */
+#define NTUPLE_SCALE        16
+
+#define NTUPLE_MAX_TUPLES   8
+#define NTUPLE_MAX_CELLS    6
+
+enum ntuple_layout
+{
+  NTUPLE_LAYOUT_SMALL   = 0,    /* five 4-cell patterns, 1.3MB */
+  NTUPLE_LAYOUT_LARGE   = 1,    /* four 6-cell patterns, 256MB */
+  BOTTOM_OF_NTUPLE_LAYOUT
+};
+
+bool ntuple_create(ntuple **self, enum ntuple_layout layout);
+bool ntuple_load(ntuple **self, const char *path);
+void ntuple_destory(ntuple **self);
+bool ntuple_save(ntuple *self, const char *path);
+int32 ntuple_get_value(ntuple *self, bitboard b);
+void ntuple_get_values(ntuple *self, const bitboard *boards, size_t n,
+  int32 *out);
+float ntuple_get_estimate(ntuple *self, bitboard b);
+void ntuple_update(ntuple *self, bitboard b, float delta);
+
+#endif /* __NTUPLE_H__ */
@@ -16,6 +16,7 @@ typedef struct _tree
   list                  *leaf_nodes;
   uint32                depth;
   uint32                degree;
+  uint32                size;       /* nodes in use */
 } tree;
 
 struct _tree_node
@@ -48,6 +49,7 @@ bool tree_create(tree **self)
     list_create(&(*self)->leaf_nodes);
     (*self)->depth = 0;
     (*self)->degree = 0;
+    (*self)->size = 0;
     ret = true;
   }
 
@@ -284,6 +286,18 @@ uint32 tree_get_degree(tree *self)
   return degree;
 }
 
+uint32 tree_get_size(tree *self)
+{
+  uint32 size = 0;
+
+  if (self != NULL)
+  {
+    size = self->size;
+  }
+
+  return size;
+}
+
 uint32 tree_get_node_degree(tree *self, tree_node *node)
 {
   uint32 degree = 0;
@@ -384,6 +398,7 @@ static tree_node *tree_get_new_node(tree *self)
     node->parent = NULL;
     node->first_child = NULL;
     node->next_sibling = NULL;
+    self->size++;
   }
 
   return node;
@@ -403,6 +418,7 @@ static void tree_put_unused_node(tree *self, tree_node *node)
     }
     node->data = NULL;
   }
+  self->size--;
   list_add_to_last(self->unused_nodes, (void *)node);
 }
 
@@ -22,6 +22,7 @@ tree_node *tree_get_sibling(tree *self, tree_node *node);
 void *tree_get_data(tree *self, tree_node *node);
 uint32 tree_get_depth(tree *self);
 uint32 tree_get_degree(tree *self);
+uint32 tree_get_size(tree *self);
 uint32 tree_get_node_degree(tree *self, tree_node *node);
 uint32 tree_get_node_level(tree *self, tree_node *node);
 tree_node *tree_find_node(tree *self, void *data);
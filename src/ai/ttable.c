@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ttable.h"
+
+/*
+ * Slots are picked by the low bits of the Zobrist hash and hold the whole
+ * board, so a probe never takes another board's result.  The same board
+ * turns up on both turns, so the turn moves it to another slot.  A slot goes to
+ * the deeper search, unless its entry is from an older generation: those
+ * were stored for earlier game moves and give way to anything.
+ */
+typedef struct _ttable
+{
+  ttable_entry  *entries;
+  uint64        mask;
+  uint8         generation;
+  uint64        hits;
+  uint64        misses;         /* free slots */
+  uint64        collisions;     /* slots holding another board */
+} ttable;
+
+/* xored into the hash of boards on the computer's turn */
+#define TTABLE_COMPUTER_KEY   0x9E3779B97F4A7C15ULL
+
+static inline ttable_entry *ttable_slot(ttable *self, uint64 hash,
+  enum round r);
+
+bool ttable_create(ttable **self, uint32 megabytes)
+{
+  bool ret = false;
+  uint64 count = 1;
+
+  if (megabytes == 0)
+  {
+    return ret;
+  }
+
+  /* the largest power of two that fits */
+  while ((count << 1) * sizeof(ttable_entry) <= ((uint64)megabytes << 20))
+  {
+    count <<= 1;
+  }
+
+  *self = (ttable *)malloc(sizeof(ttable));
+  if (*self != NULL)
+  {
+    (*self)->entries = (ttable_entry *)malloc(sizeof(ttable_entry) * count);
+    if ((*self)->entries != NULL)
+    {
+      (*self)->mask = count - 1;
+      ttable_clear(*self);
+      ttable_reset_stats(*self);
+      ret = true;
+    }
+    else
+    {
+      free(*self);
+      *self = NULL;
+    }
+  }
+
+  return ret;
+}
+
+void ttable_destory(ttable **self)
+{
+  if (*self != NULL)
+  {
+    free((*self)->entries);
+    free(*self);
+    *self = NULL;
+  }
+}
+
+void ttable_clear(ttable *self)
+{
+  if (self != NULL)
+  {
+    memset(self->entries, 0, sizeof(ttable_entry) * (self->mask + 1));
+    self->generation = 0;
+  }
+}
+
+/* entries stored before now are free to replace */
+void ttable_new_generation(ttable *self)
+{
+  if (self != NULL)
+  {
+    self->generation++;
+  }
+}
+
+/* the entry for b on r's turn, or NULL */
+const ttable_entry *ttable_probe(ttable *self, uint64 hash, bitboard b,
+  enum round r)
+{
+  ttable_entry *entry = NULL;
+
+  if (self == NULL)
+  {
+    return NULL;
+  }
+
+  entry = ttable_slot(self, hash, r);
+  if (entry->depth == 0)
+  {
+    self->misses++;
+    return NULL;
+  }
+  if (entry->b != b || entry->r != (uint8)r)
+  {
+    self->collisions++;
+    return NULL;
+  }
+  self->hits++;
+
+  return entry;
+}
+
+void ttable_store(ttable *self, uint64 hash, bitboard b, enum round r,
+  uint32 depth, int32 value, enum ttable_bound bound, enum direction best)
+{
+  ttable_entry *entry = NULL;
+
+  if (self == NULL || depth == 0)
+  {
+    return;
+  }
+
+  entry = ttable_slot(self, hash, r);
+  if (entry->depth == 0 || entry->generation != self->generation
+    || depth >= entry->depth)
+  {
+    entry->b = b;
+    entry->value = value;
+    entry->depth = (uint8)depth;
+    entry->generation = self->generation;
+    entry->best = (uint8)best;
+    entry->bound = (uint8)bound;
+    entry->r = (uint8)r;
+  }
+}
+
+void ttable_get_stats(ttable *self, uint64 *hits, uint64 *misses,
+  uint64 *collisions)
+{
+  if (self != NULL)
+  {
+    *hits = self->hits;
+    *misses = self->misses;
+    *collisions = self->collisions;
+  }
+}
+
+void ttable_reset_stats(ttable *self)
+{
+  if (self != NULL)
+  {
+    self->hits = 0;
+    self->misses = 0;
+    self->collisions = 0;
+  }
+}
+
+static inline ttable_entry *ttable_slot(ttable *self, uint64 hash,
+  enum round r)
+{
+  if (r == COMPUTER_TURN)
+  {
+    hash ^= TTABLE_COMPUTER_KEY;
+  }
+
+  return &self->entries[hash & self->mask];
+}
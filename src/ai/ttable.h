@@ -0,0 +1,45 @@
+#ifndef __TTABLE_H__
+#define __TTABLE_H__
+
+#include "constants.h"
+#include "../models/bitboard.h"
+
+/*
+ * Transposition table: search results by board, so a position reached
+ * through different move orders is searched once.  One entry per slot,
+ * 16 bytes, a power of two of them.
+ */
+typedef struct _ttable ttable;
+
+enum ttable_bound
+{
+  TTABLE_EXACT          = 0,
+  TTABLE_LOWER          = 1,    /* failed high, the value is at least this */
+  TTABLE_UPPER          = 2,    /* failed low, the value is at most this */
+  BOTTOM_OF_TTABLE_BOUND
+};
+
+typedef struct _ttable_entry
+{
+  bitboard  b;
+  int32     value;
+  uint8     depth;        /* levels searched below, 0 for a free slot */
+  uint8     generation;
+  uint8     best;         /* enum direction */
+  uint8     bound : 2;    /* enum ttable_bound */
+  uint8     r : 1;        /* enum round */
+} ttable_entry;
+
+bool ttable_create(ttable **self, uint32 megabytes);
+void ttable_destory(ttable **self);
+void ttable_clear(ttable *self);
+void ttable_new_generation(ttable *self);
+const ttable_entry *ttable_probe(ttable *self, uint64 hash, bitboard b,
+  enum round r);
+void ttable_store(ttable *self, uint64 hash, bitboard b, enum round r,
+  uint32 depth, int32 value, enum ttable_bound bound, enum direction best);
+void ttable_get_stats(ttable *self, uint64 *hits, uint64 *misses,
+  uint64 *collisions);
+void ttable_reset_stats(ttable *self);
+
+#endif /* __TTABLE_H__ */
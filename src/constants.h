@@ -3,7 +3,7 @@
 
 #include "log.h"
 
-typedef char                  int8;
+typedef signed char           int8;
 typedef short                 int16;
 typedef int                   int32;
 typedef long long             int64;
@@ -27,9 +27,12 @@ typedef enum boolean
 #define THINKING_DURATION     200     /* in million seconds */
 #define MIN_SEARCH_DEPTH      3
 #define MAX_SEARCH_DEPTH      15
+#define TABLE_SIZE_MB         16      /* transposition table, 0 for none */
 
-#define ROWS_OF_BOARD    4
+#define ROWS_OF_BOARD    4        /* default, chosen at startup */
 #define COLS_OF_BOARD    4
+#define MAX_ROWS_OF_BOARD    8
+#define MAX_COLS_OF_BOARD    8
 
 #define GAME_INIT_NUMBER_COUNT  3
 #define GAME_INIT_NUMBER        2
@@ -18,17 +18,115 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "models/game.h"
 
-int main()
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-r rows] [-c cols] [-s size] [-w weights]"
+		" [-e evaluator] [-t megabytes]\n"
+		"       [-a minmax|minmax-tree|best-first|expectimax]\n", name);
+	fprintf(stderr, "  board sides range from 2 to %u and %u, default %ux%u\n",
+		MAX_ROWS_OF_BOARD, MAX_COLS_OF_BOARD, ROWS_OF_BOARD, COLS_OF_BOARD);
+	fprintf(stderr, "  weights is an n-tuple network file for the 4x4 ai\n");
+	fprintf(stderr, "  evaluator is a heuristic weights file from 2048_tune\n");
+	fprintf(stderr, "  megabytes sizes the search transposition table,"
+		" default %u, 0 for none\n", TABLE_SIZE_MB);
+	fprintf(stderr, "  -a picks the ai search, minmax by default; minmax-tree"
+		" keeps the whole\n  game tree in memory, for analysis, and best-first grows"
+		" it at the\n  most promising leaf\n");
+}
+
+int main(int argc, char *argv[])
 {
 	game *g = NULL;
+	uint32 rows = ROWS_OF_BOARD;
+	uint32 cols = COLS_OF_BOARD;
+	const char *weights = NULL;
+	const char *evaluator = NULL;
+	int table = -1;
+	const char *engine = NULL;
+	float w[4];
+	FILE *fp = NULL;
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "r:c:s:w:e:t:a:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r':
+				rows = (uint32)atoi(optarg);
+				break;
+			case 'c':
+				cols = (uint32)atoi(optarg);
+				break;
+			case 's':
+				rows = cols = (uint32)atoi(optarg);
+				break;
+			case 'w':
+				weights = optarg;
+				break;
+			case 'e':
+				evaluator = optarg;
+				break;
+			case 't':
+				table = atoi(optarg);
+				break;
+			case 'a':
+				engine = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return (1);
+		}
+	}
 
-	if (game_create(&g) == true)
+	if (game_create(&g, rows, cols) == true)
 	{
+		if (weights != NULL && game_load_weights(g, weights) == false)
+		{
+			fprintf(stderr, "could not load weights from %s\n", weights);
+			game_destory(&g);
+			return (1);
+		}
+		if (evaluator != NULL)
+		{
+			/* smoothness, monotonicity, empty and max value weights */
+			fp = fopen(evaluator, "r");
+			if (fp == NULL
+				|| fscanf(fp, "%f %f %f %f", &w[0], &w[1], &w[2], &w[3]) != 4
+				|| game_set_weights(g, w[0], w[1], w[2], w[3]) == false)
+			{
+				fprintf(stderr, "could not load weights from %s\n", evaluator);
+				if (fp != NULL)
+				{
+					fclose(fp);
+				}
+				game_destory(&g);
+				return (1);
+			}
+			fclose(fp);
+		}
+		if (table >= 0 && game_set_table_size(g, (uint32)table) == false)
+		{
+			fprintf(stderr, "could not set up a %dMB table\n", table);
+			game_destory(&g);
+			return (1);
+		}
+		if (engine != NULL && game_set_engine(g, engine) == false)
+		{
+			fprintf(stderr, "unknown search %s\n", engine);
+			game_destory(&g);
+			return (1);
+		}
 		game_start(g);
 	}
+	else
+	{
+		usage(argv[0]);
+	}
 	game_destory(&g);
 
 	return (0);
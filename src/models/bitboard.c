@@ -0,0 +1,147 @@
+#include "bitboard.h"
+
+uint64 bitboard_zobrist[BITBOARD_HASH_CELLS][BITBOARD_HASH_EXPONENTS];
+
+/* fixed seed, so hashes are stable from run to run */
+static void __attribute__((constructor)) bitboard_init_zobrist(void)
+{
+  uint64 state = 0x2048204820482048ULL;
+  uint64 z = 0;
+  uint32 cell = 0, exp = 0;
+
+  for (cell = 0; cell < BITBOARD_HASH_CELLS; cell++)
+  {
+    bitboard_zobrist[cell][0] = 0;
+    for (exp = 1; exp < BITBOARD_HASH_EXPONENTS; exp++)
+    {
+      /* splitmix64 */
+      state += 0x9E3779B97F4A7C15ULL;
+      z = state;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      bitboard_zobrist[cell][exp] = z ^ (z >> 31);
+    }
+  }
+}
+
+/*
+ * The eight symmetries of the square are numbered by three bits applied in
+ * this order: BITBOARD_SYM_TRANSPOSE, then BITBOARD_SYM_FLIP_H (mirror the
+ * columns), then BITBOARD_SYM_FLIP_V (mirror the rows).  Moving a board
+ * then applying a symmetry equals applying it first and moving in the
+ * mapped direction.
+ */
+static const enum direction transpose_dir[BOTTOM_OF_DIRECTION] =
+{
+  LEFT, RIGHT, UP, DOWN
+};
+
+static const enum direction flip_h_dir[BOTTOM_OF_DIRECTION] =
+{
+  UP, DOWN, RIGHT, LEFT
+};
+
+static const enum direction flip_v_dir[BOTTOM_OF_DIRECTION] =
+{
+  DOWN, UP, LEFT, RIGHT
+};
+
+bitboard bitboard_apply_symmetry(bitboard b, uint32 sym)
+{
+  if (sym & BITBOARD_SYM_TRANSPOSE)
+  {
+    b = bitboard_transpose(b);
+  }
+  if (sym & BITBOARD_SYM_FLIP_H)
+  {
+    b = bitboard_flip_horizontal(b);
+  }
+  if (sym & BITBOARD_SYM_FLIP_V)
+  {
+    b = bitboard_flip_vertical(b);
+  }
+
+  return b;
+}
+
+bitboard bitboard_canonical(bitboard b, uint32 *sym)
+{
+  bitboard t = bitboard_transpose(b);
+  bitboard candidates[BITBOARD_SYMMETRIES];
+  bitboard best = 0;
+  uint32 i = 0, best_sym = 0;
+
+  candidates[0] = b;
+  candidates[BITBOARD_SYM_FLIP_H] = bitboard_flip_horizontal(b);
+  candidates[BITBOARD_SYM_FLIP_V] = bitboard_flip_vertical(b);
+  candidates[BITBOARD_SYM_FLIP_H | BITBOARD_SYM_FLIP_V] =
+    bitboard_flip_vertical(candidates[BITBOARD_SYM_FLIP_H]);
+  candidates[BITBOARD_SYM_TRANSPOSE] = t;
+  candidates[BITBOARD_SYM_TRANSPOSE | BITBOARD_SYM_FLIP_H] =
+    bitboard_flip_horizontal(t);
+  candidates[BITBOARD_SYM_TRANSPOSE | BITBOARD_SYM_FLIP_V] =
+    bitboard_flip_vertical(t);
+  candidates[BITBOARD_SYMMETRIES - 1] =
+    bitboard_flip_vertical(candidates[BITBOARD_SYM_TRANSPOSE | BITBOARD_SYM_FLIP_H]);
+
+  best = candidates[0];
+  for (i = 1; i < BITBOARD_SYMMETRIES; i++)
+  {
+    if (candidates[i] < best)
+    {
+      best = candidates[i];
+      best_sym = i;
+    }
+  }
+
+  if (sym != NULL)
+  {
+    *sym = best_sym;
+  }
+
+  return best;
+}
+
+enum direction bitboard_symmetry_direction(uint32 sym, enum direction dir)
+{
+  if (dir >= BOTTOM_OF_DIRECTION)
+  {
+    return dir;
+  }
+  if (sym & BITBOARD_SYM_TRANSPOSE)
+  {
+    dir = transpose_dir[dir];
+  }
+  if (sym & BITBOARD_SYM_FLIP_H)
+  {
+    dir = flip_h_dir[dir];
+  }
+  if (sym & BITBOARD_SYM_FLIP_V)
+  {
+    dir = flip_v_dir[dir];
+  }
+
+  return dir;
+}
+
+enum direction bitboard_symmetry_direction_back(uint32 sym, enum direction dir)
+{
+  if (dir >= BOTTOM_OF_DIRECTION)
+  {
+    return dir;
+  }
+  if (sym & BITBOARD_SYM_FLIP_V)
+  {
+    dir = flip_v_dir[dir];
+  }
+  if (sym & BITBOARD_SYM_FLIP_H)
+  {
+    dir = flip_h_dir[dir];
+  }
+  if (sym & BITBOARD_SYM_TRANSPOSE)
+  {
+    dir = transpose_dir[dir];
+  }
+
+  return dir;
+}
@@ -0,0 +1,246 @@
+#ifndef __BITBOARD_H__
+#define __BITBOARD_H__
+
+#include "constants.h"
+
+/*
+ * A 4x4 board packed into a single 64-bit word.  Every cell holds the
+ * exponent of its tile in 4 bits (0 means empty, 1 means 2, 2 means 4 ...),
+ * so the largest representable tile is 32768.  Cell (x, y) lives in nibble
+ * y * BITBOARD_COLS + x, hence row y occupies bits [16 * y, 16 * y + 16).
+ * Boards are plain values: assignment clones and == compares.
+ */
+typedef uint64 bitboard;
+
+#define BITBOARD_ROWS         4
+#define BITBOARD_COLS         4
+#define BITBOARD_CELLS        (BITBOARD_ROWS * BITBOARD_COLS)
+#define BITBOARD_CELL_BITS    4
+#define BITBOARD_CELL_MASK    0xFULL
+#define BITBOARD_ROW_BITS     (BITBOARD_COLS * BITBOARD_CELL_BITS)
+#define BITBOARD_ROW_MASK     0xFFFFULL
+#define BITBOARD_MAX_EXPONENT 15
+
+static inline uint32 bitboard_get(bitboard b, uint32 x, uint32 y)
+{
+  return (uint32)((b >> ((y * BITBOARD_COLS + x) * BITBOARD_CELL_BITS))
+    & BITBOARD_CELL_MASK);
+}
+
+static inline bitboard bitboard_set(bitboard b, uint32 x, uint32 y, uint32 exp)
+{
+  uint32 shift = (y * BITBOARD_COLS + x) * BITBOARD_CELL_BITS;
+  return (b & ~(BITBOARD_CELL_MASK << shift))
+    | (((bitboard)exp & BITBOARD_CELL_MASK) << shift);
+}
+
+static inline uint32 bitboard_get_row(bitboard b, uint32 y)
+{
+  return (uint32)((b >> (y * BITBOARD_ROW_BITS)) & BITBOARD_ROW_MASK);
+}
+
+static inline bitboard bitboard_set_row(bitboard b, uint32 y, uint32 row)
+{
+  uint32 shift = y * BITBOARD_ROW_BITS;
+  return (b & ~(BITBOARD_ROW_MASK << shift))
+    | (((bitboard)row & BITBOARD_ROW_MASK) << shift);
+}
+
+static inline bool bitboard_is_equal(bitboard b, bitboard other)
+{
+  return (b == other) ? true : false;
+}
+
+/* mirror the board along its main diagonal, rows become columns */
+static inline bitboard bitboard_transpose(bitboard b)
+{
+  bitboard a1 = b & 0xF0F00F0FF0F00F0FULL;
+  bitboard a2 = b & 0x0000F0F00000F0F0ULL;
+  bitboard a3 = b & 0x0F0F00000F0F0000ULL;
+  bitboard a = a1 | (a2 << 12) | (a3 >> 12);
+  bitboard b1 = a & 0xFF00FF0000FF00FFULL;
+  bitboard b2 = a & 0x00FF00FF00000000ULL;
+  bitboard b3 = a & 0x00000000FF00FF00ULL;
+  return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+/* mirror the columns, x becomes BITBOARD_COLS - 1 - x */
+static inline bitboard bitboard_flip_horizontal(bitboard b)
+{
+  return ((b & 0x000F000F000F000FULL) << 12)
+    | ((b & 0x00F000F000F000F0ULL) << 4)
+    | ((b & 0x0F000F000F000F00ULL) >> 4)
+    | ((b & 0xF000F000F000F000ULL) >> 12);
+}
+
+/* mirror the rows, y becomes BITBOARD_ROWS - 1 - y */
+static inline bitboard bitboard_flip_vertical(bitboard b)
+{
+  return (b << 48)
+    | ((b & 0x00000000FFFF0000ULL) << 16)
+    | ((b & 0x0000FFFF00000000ULL) >> 16)
+    | (b >> 48);
+}
+
+/* low bit of every nibble set when the cell holds a tile */
+static inline bitboard bitboard_occupied(bitboard b)
+{
+  b |= b >> 2;
+  b |= b >> 1;
+  return b & 0x1111111111111111ULL;
+}
+
+/* bit i set when cell i (nibble i) is empty */
+static inline uint32 bitboard_empty_mask(bitboard b)
+{
+  bitboard x = bitboard_occupied(b) ^ 0x1111111111111111ULL;
+  x = (x | (x >> 3)) & 0x0303030303030303ULL;
+  x = (x | (x >> 6)) & 0x000F000F000F000FULL;
+  x = (x | (x >> 12)) & 0x000000FF000000FFULL;
+  x = (x | (x >> 24)) & 0x000000000000FFFFULL;
+  return (uint32)x;
+}
+
+static inline uint32 bitboard_count_empty(bitboard b)
+{
+  return (uint32)__builtin_popcount(bitboard_empty_mask(b));
+}
+
+/*
+ * Write the index of every empty cell into cells, which must hold
+ * BITBOARD_CELLS entries, and return how many were written.
+ */
+static inline uint32 bitboard_get_empty(bitboard b, uint8 *cells)
+{
+  uint32 mask = bitboard_empty_mask(b);
+  uint32 len = 0;
+
+  while (mask != 0)
+  {
+    cells[len++] = (uint8)__builtin_ctz(mask);
+    mask &= mask - 1;
+  }
+
+  return len;
+}
+
+static inline bitboard bitboard_set_cell(bitboard b, uint32 cell, uint32 exp)
+{
+  uint32 shift = cell * BITBOARD_CELL_BITS;
+  return (b & ~(BITBOARD_CELL_MASK << shift))
+    | (((bitboard)exp & BITBOARD_CELL_MASK) << shift);
+}
+
+/* tile value <-> exponent, 0 stays 0 */
+static inline uint32 bitboard_exponent_to_value(uint32 exp)
+{
+  return (exp == 0) ? 0 : ((uint32)1 << exp);
+}
+
+static inline uint32 bitboard_value_to_exponent(uint32 val)
+{
+  return (val == 0) ? 0 : (uint32)__builtin_ctz(val);
+}
+
+static inline uint32 bitboard_get_value(bitboard b, uint32 x, uint32 y)
+{
+  return bitboard_exponent_to_value(bitboard_get(b, x, y));
+}
+
+static inline bitboard bitboard_set_value(bitboard b, uint32 x, uint32 y,
+  uint32 val)
+{
+  return bitboard_set(b, x, y, bitboard_value_to_exponent(val));
+}
+
+/* xorshift64*, for seeded games played without the game model */
+static inline uint64 bitboard_random(uint64 *rng)
+{
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return *rng * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * Spawn a tile on a random empty cell of b as the game does: any value of
+ * GAME_NUBMER_ELEMENTS, all equally likely.  A full board is returned as is.
+ */
+static inline bitboard bitboard_spawn(bitboard b, uint64 *rng)
+{
+  uint32 values[] = GAME_NUBMER_ELEMENTS;
+  uint8 cells[BITBOARD_CELLS];
+  uint32 len = bitboard_get_empty(b, cells);
+
+  if (len == 0)
+  {
+    return b;
+  }
+
+  return bitboard_set_cell(b, cells[bitboard_random(rng) % len],
+    bitboard_value_to_exponent(values[bitboard_random(rng)
+    % ARRAY_SIZE(values)]));
+}
+
+/*
+ * Zobrist keys, one per (cell, exponent); the empty exponent keys to 0 so
+ * a board hashes to the XOR of the keys of its tiles.  The table is sized
+ * for the largest board and is filled before main runs.
+ */
+#define BITBOARD_HASH_CELLS       (MAX_ROWS_OF_BOARD * MAX_COLS_OF_BOARD)
+#define BITBOARD_HASH_EXPONENTS   32
+
+extern uint64 bitboard_zobrist[BITBOARD_HASH_CELLS][BITBOARD_HASH_EXPONENTS];
+
+static inline uint64 bitboard_hash_key(uint32 cell, uint32 exp)
+{
+  return bitboard_zobrist[cell][exp & (BITBOARD_HASH_EXPONENTS - 1)];
+}
+
+static inline uint64 bitboard_hash(bitboard b)
+{
+  uint64 hash = 0;
+  uint32 cell = 0;
+
+  for (cell = 0; cell < BITBOARD_CELLS; cell++)
+  {
+    hash ^= bitboard_hash_key(cell, (uint32)(b & BITBOARD_CELL_MASK));
+    b >>= BITBOARD_CELL_BITS;
+  }
+
+  return hash;
+}
+
+/* rehash only the cells that differ between before and after */
+static inline uint64 bitboard_hash_update(uint64 hash, bitboard before,
+  bitboard after)
+{
+  bitboard changed = bitboard_occupied(before ^ after);
+  uint32 cell = 0, shift = 0;
+
+  while (changed != 0)
+  {
+    shift = (uint32)__builtin_ctzll(changed);
+    cell = shift / BITBOARD_CELL_BITS;
+    hash ^= bitboard_hash_key(cell,
+      (uint32)((before >> shift) & BITBOARD_CELL_MASK));
+    hash ^= bitboard_hash_key(cell,
+      (uint32)((after >> shift) & BITBOARD_CELL_MASK));
+    changed &= changed - 1;
+  }
+
+  return hash;
+}
+
+/* dihedral symmetries, see bitboard.c */
+#define BITBOARD_SYM_FLIP_H     0x1
+#define BITBOARD_SYM_FLIP_V     0x2
+#define BITBOARD_SYM_TRANSPOSE  0x4
+#define BITBOARD_SYMMETRIES     8
+
+bitboard bitboard_apply_symmetry(bitboard b, uint32 sym);
+bitboard bitboard_canonical(bitboard b, uint32 *sym);
+enum direction bitboard_symmetry_direction(uint32 sym, enum direction dir);
+enum direction bitboard_symmetry_direction_back(uint32 sym, enum direction dir);
+
+#endif /* __BITBOARD_H__ */
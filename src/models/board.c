@@ -1,49 +1,234 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "board.h"
 
+#if defined(__SIZEOF_INT128__)
+#define BOARD_HAS_WIDE
+typedef unsigned __int128 board_wide;
+#define BOARD_WIDE_SIZE         5
+#define BOARD_WIDE_CELL_BITS    5
+#define BOARD_WIDE_CELL_MASK    0x1F
+#endif
+
+#define BOARD_ARRAY_SIZE        6
+#define BOARD_MAX_LINE \
+  ((MAX_ROWS_OF_BOARD > MAX_COLS_OF_BOARD) ? MAX_ROWS_OF_BOARD : MAX_COLS_OF_BOARD)
+
+typedef struct _board_kernel board_kernel;
+
 typedef struct _board
 {
   uint32 rows;
   uint32 cols;
-  uint32 **contents;
+  const board_kernel *kernel;
+  uint64 hash;                      /* Zobrist hash, cell y * cols + x */
+  union
+  {
+    bitboard bits;                  /* 4x4, 4-bit exponents */
+#if defined(BOARD_HAS_WIDE)
+    board_wide wide;                /* 5x5, 5-bit exponents */
+#endif
+    uint8 exps[MAX_ROWS_OF_BOARD * MAX_COLS_OF_BOARD];
+  } cells;
 } board;
 
-bool board_create(board **self, uint32 rows, uint32 cols)
+/* per-shape storage access and move engine, picked by board_create */
+struct _board_kernel
 {
-  bool ret = false;
-  uint32 *buffer = NULL;
+  uint32 (*get)(board *self, uint32 x, uint32 y);
+  void (*set)(board *self, uint32 x, uint32 y, uint32 exp);
+  bool (*move)(board *self, board *next, enum direction dir, uint64 *score);
+  uint32 (*legal_moves)(board *self);
+};
 
-  *self = (board *)malloc(sizeof(board));
-  if (*self == NULL)
+/* cell i of the line swept towards dir, line l counted from the left/top */
+#define BOARD_LINE_X(dir, l, i, COLS) \
+  (((dir) == UP || (dir) == DOWN) ? (l) : \
+   ((dir) == LEFT) ? (i) : ((COLS) - 1 - (i)))
+#define BOARD_LINE_Y(dir, l, i, ROWS) \
+  (((dir) == LEFT || (dir) == RIGHT) ? (l) : \
+   ((dir) == UP) ? (i) : ((ROWS) - 1 - (i)))
+
+/*
+ * BOARD_KERNEL expands to the accessors, move and legal-move routines of
+ * one board shape.  GET(self, x, y) and SET(self, x, y, exp) address one
+ * exponent; ROWS and COLS are constants for the specialized shapes, so
+ * every line loop is unrolled, and the runtime dimensions for the generic
+ * kernel.  MAX is the largest exponent a cell holds, tiles at it stay.
+ */
+#define BOARD_KERNEL(name, ROWS, COLS, MAX, GET, SET) \
+static uint32 name##_get(board *self, uint32 x, uint32 y) \
+{ \
+  return GET(self, x, y); \
+} \
+\
+static void name##_set(board *self, uint32 x, uint32 y, uint32 exp) \
+{ \
+  SET(self, x, y, exp); \
+} \
+\
+static bool name##_move(board *self, board *next, enum direction dir, \
+  uint64 *score) \
+{ \
+  bool ret = false; \
+  uint32 line[BOARD_MAX_LINE]; \
+  uint32 lines = (dir == UP || dir == DOWN) ? (COLS) : (ROWS); \
+  uint32 len = (dir == UP || dir == DOWN) ? (ROWS) : (COLS); \
+  uint32 l = 0, i = 0, merged = 0; \
+\
+  for (l = 0; l < lines; l++) \
+  { \
+    for (i = 0; i < len; i++) \
+    { \
+      line[i] = GET(self, BOARD_LINE_X(dir, l, i, COLS), \
+        BOARD_LINE_Y(dir, l, i, ROWS)); \
+    } \
+    if (board_slide_line(line, len, (MAX), &merged) == true) \
+    { \
+      ret = true; \
+      if (merged != 0) \
+      { \
+        *score += (uint64)1 << merged; \
+      } \
+    } \
+    for (i = 0; i < len; i++) \
+    { \
+      SET(next, BOARD_LINE_X(dir, l, i, COLS), \
+        BOARD_LINE_Y(dir, l, i, ROWS), line[i]); \
+    } \
+  } \
+\
+  return ret; \
+} \
+\
+static uint32 name##_legal_moves(board *self) \
+{ \
+  uint32 mask = 0; \
+  uint32 x = 0, y = 0, a = 0, b = 0; \
+\
+  for (y = 0; y < (ROWS); y++) \
+  { \
+    for (x = 0; x < (COLS); x++) \
+    { \
+      a = GET(self, x, y); \
+      if (x + 1 < (COLS)) \
+      { \
+        b = GET(self, x + 1, y); \
+        if (a == 0 && b != 0) mask |= 1U << LEFT; \
+        if (a != 0 && b == 0) mask |= 1U << RIGHT; \
+        if (a != 0 && a == b && a < (MAX)) \
+          mask |= (1U << LEFT) | (1U << RIGHT); \
+      } \
+      if (y + 1 < (ROWS)) \
+      { \
+        b = GET(self, x, y + 1); \
+        if (a == 0 && b != 0) mask |= 1U << UP; \
+        if (a != 0 && b == 0) mask |= 1U << DOWN; \
+        if (a != 0 && a == b && a < (MAX)) \
+          mask |= (1U << UP) | (1U << DOWN); \
+      } \
+    } \
+  } \
+\
+  return mask; \
+} \
+\
+static const board_kernel name = \
+{ \
+  name##_get, name##_set, name##_move, name##_legal_moves \
+};
+
+#define BOARD_BITS_GET(s, x, y)         bitboard_get((s)->cells.bits, x, y)
+#define BOARD_BITS_SET(s, x, y, e) \
+  ((s)->cells.bits = bitboard_set((s)->cells.bits, x, y, e))
+BOARD_KERNEL(board_kernel_bits, BITBOARD_ROWS, BITBOARD_COLS,
+  BITBOARD_MAX_EXPONENT, BOARD_BITS_GET, BOARD_BITS_SET)
+
+#if defined(BOARD_HAS_WIDE)
+#define BOARD_WIDE_SHIFT(x, y) \
+  (((y) * BOARD_WIDE_SIZE + (x)) * BOARD_WIDE_CELL_BITS)
+#define BOARD_WIDE_GET(s, x, y) \
+  ((uint32)((s)->cells.wide >> BOARD_WIDE_SHIFT(x, y)) & BOARD_WIDE_CELL_MASK)
+#define BOARD_WIDE_SET(s, x, y, e) \
+  ((s)->cells.wide = ((s)->cells.wide \
+    & ~((board_wide)BOARD_WIDE_CELL_MASK << BOARD_WIDE_SHIFT(x, y))) \
+    | ((board_wide)((e) & BOARD_WIDE_CELL_MASK) << BOARD_WIDE_SHIFT(x, y)))
+BOARD_KERNEL(board_kernel_wide, BOARD_WIDE_SIZE, BOARD_WIDE_SIZE,
+  BOARD_WIDE_CELL_MASK, BOARD_WIDE_GET, BOARD_WIDE_SET)
+#endif
+
+#define BOARD_ARRAY_GET(s, x, y) \
+  ((uint32)(s)->cells.exps[(y) * BOARD_ARRAY_SIZE + (x)])
+#define BOARD_ARRAY_SET(s, x, y, e) \
+  ((s)->cells.exps[(y) * BOARD_ARRAY_SIZE + (x)] = (uint8)(e))
+BOARD_KERNEL(board_kernel_array, BOARD_ARRAY_SIZE, BOARD_ARRAY_SIZE,
+  UINT8_MAX, BOARD_ARRAY_GET, BOARD_ARRAY_SET)
+
+#define BOARD_GENERIC_GET(s, x, y) \
+  ((uint32)(s)->cells.exps[(y) * (s)->cols + (x)])
+#define BOARD_GENERIC_SET(s, x, y, e) \
+  ((s)->cells.exps[(y) * (s)->cols + (x)] = (uint8)(e))
+BOARD_KERNEL(board_kernel_generic, self->rows, self->cols, UINT8_MAX,
+  BOARD_GENERIC_GET, BOARD_GENERIC_SET)
+
+static void board_rehash(board *self)
+{
+  uint32 x = 0, y = 0;
+
+  self->hash = 0;
+  for (y = 0; y < self->rows; y++)
   {
-    return ret;
+    for (x = 0; x < self->cols; x++)
+    {
+      self->hash ^= bitboard_hash_key(y * self->cols + x,
+        self->kernel->get(self, x, y));
+    }
   }
+}
 
-  (*self)->rows = rows;
-  (*self)->cols = cols;
-
-  (*self)->contents = (uint32 **)malloc(sizeof(uint32 *) * rows);
-  if ((*self)->contents == NULL)
+static const board_kernel *board_select_kernel(uint32 rows, uint32 cols)
+{
+  if (rows == BITBOARD_ROWS && cols == BITBOARD_COLS)
   {
-    board_destory(self);
-    return ret;
+    return &board_kernel_bits;
+  }
+#if defined(BOARD_HAS_WIDE)
+  if (rows == BOARD_WIDE_SIZE && cols == BOARD_WIDE_SIZE)
+  {
+    return &board_kernel_wide;
+  }
+#endif
+  if (rows == BOARD_ARRAY_SIZE && cols == BOARD_ARRAY_SIZE)
+  {
+    return &board_kernel_array;
   }
+  return &board_kernel_generic;
+}
 
-  buffer = (uint32 *)malloc(sizeof(uint32) * rows * cols);
-  if (buffer == NULL)
+bool board_create(board **self, uint32 rows, uint32 cols)
+{
+  bool ret = false;
+
+  if (rows < 2 || cols < 2
+    || rows > MAX_ROWS_OF_BOARD || cols > MAX_COLS_OF_BOARD)
   {
-    board_destory(self);
+    *self = NULL;
     return ret;
   }
 
-  memset((char *)buffer, 0x00, sizeof(uint32) * rows * cols);
-  int i = 0;
-  for (i = 0; i < rows; i++)
+  *self = (board *)malloc(sizeof(board));
+  if (*self == NULL)
   {
-    (*self)->contents[i] = buffer + i * cols;
+    return ret;
   }
+
+  (*self)->rows = rows;
+  (*self)->cols = cols;
+  (*self)->kernel = board_select_kernel(rows, cols);
+  (*self)->hash = 0;
+  memset((char *)&(*self)->cells, 0x00, sizeof((*self)->cells));
   ret = true;
 
   return ret;
@@ -51,18 +236,6 @@ bool board_create(board **self, uint32 rows, uint32 cols)
 
 void board_destory(board **self)
 {
-  if ((*self)->contents[0] != NULL)
-  {
-    free((*self)->contents[0]);
-    (*self)->contents[0] = NULL;
-  }
-
-  if ((*self)->contents != NULL)
-  {
-    free((*self)->contents);
-    (*self)->contents = NULL;
-  }
-
   if (*self != NULL)
   {
     free(*self);
@@ -100,7 +273,11 @@ void board_set_value(board *self, uint32 x, uint32 y, uint32 val)
   {
     if (x < self->cols && y < self->rows)
     {
-      self->contents[y][x] = val;
+      uint32 cell = y * self->cols + x;
+      uint32 exp = bitboard_value_to_exponent(val);
+      self->hash ^= bitboard_hash_key(cell, self->kernel->get(self, x, y));
+      self->kernel->set(self, x, y, exp);
+      self->hash ^= bitboard_hash_key(cell, self->kernel->get(self, x, y));
     }
   }
 }
@@ -111,10 +288,7 @@ void board_set_value_by_pos(board *self, uint64 pos, uint32 val)
   {
     uint32 x = pos >> 32;
     uint32 y = pos & 0x00000000FFFFFFFF;
-    if (x < self->cols && y < self->rows)
-    {
-      self->contents[y][x] = val;
-    }
+    board_set_value(self, x, y, val);
   }
 }
 
@@ -124,34 +298,55 @@ uint32 board_get_value(board *self, uint32 x, uint32 y)
   {
     if (x < self->cols && y < self->rows)
     {
-      return self->contents[y][x];
+      return bitboard_exponent_to_value(self->kernel->get(self, x, y));
     }
   }
 
   return 0;
 }
 
-void board_get_empty(board *self, uint64 **array, uint32 *len)
+/*
+ * array is owned by the caller and must hold rows * cols entries.  Cells
+ * come out column by column; for a bitboard the mask is taken on the
+ * transposed board to keep that order.
+ */
+void board_get_empty(board *self, uint64 *array, uint32 *len)
 {
+  uint8 cells[BITBOARD_CELLS];
   uint32 x = 0, y = 0;
-  if (self != NULL)
+  uint32 i = 0, count = 0;
+
+  *len = 0;
+  if (self == NULL || array == NULL)
+  {
+    return;
+  }
+
+  if (self->kernel == &board_kernel_bits)
+  {
+    count = bitboard_get_empty(bitboard_transpose(self->cells.bits), cells);
+    for (i = 0; i < count; i++)
+    {
+      x = cells[i] / BITBOARD_ROWS;
+      y = cells[i] % BITBOARD_ROWS;
+      array[*len] = x;
+      array[*len] <<= 32;
+      array[*len] |= y;
+      (*len)++;
+    }
+  }
+  else
   {
-    *array = (uint64 *)malloc(sizeof(uint64) * self->rows * self->cols);
-    if (*array != NULL)
+    for (x = 0; x < self->cols; x++)
     {
-      memset((char *)*array, 0, sizeof(uint64) * self->rows * self->cols);
-      *len = 0;
-      for (x = 0; x < self->cols; x++)
+      for (y = 0; y < self->rows; y++)
       {
-        for (y = 0; y < self->rows; y++)
+        if (self->kernel->get(self, x, y) == 0)
         {
-          if (self->contents[y][x] == 0)
-          {
-            (*array)[*len] = x;
-            (*array)[*len] <<= 32;
-            (*array)[*len] |= y;
-            (*len)++;
-          }
+          array[*len] = x;
+          array[*len] <<= 32;
+          array[*len] |= y;
+          (*len)++;
         }
       }
     }
@@ -166,16 +361,24 @@ bool board_clone_data(board *self, board *mother)
   {
     uint32 rows = board_get_rows(mother);
     uint32 cols = board_get_cols(mother);
-    if (rows <= self->rows && cols <= self->cols)
+    if (rows == self->rows && cols == self->cols)
+    {
+      self->cells = mother->cells;
+      self->hash = mother->hash;
+      ret = true;
+    }
+    else if (rows <= self->rows && cols <= self->cols)
     {
       uint32 x = 0, y = 0;
-      for (x = 0; x < self->cols; x++)
+      memset((char *)&self->cells, 0x00, sizeof(self->cells));
+      for (x = 0; x < cols; x++)
       {
-        for (y = 0; y < self->rows; y++)
+        for (y = 0; y < rows; y++)
         {
-          self->contents[y][x] = mother->contents[y][x];
+          self->kernel->set(self, x, y, mother->kernel->get(mother, x, y));
         }
       }
+      board_rehash(self);
       ret = true;
     }
   }
@@ -193,20 +396,127 @@ bool board_is_equal(board *self, board *other)
     uint32 cols = board_get_cols(other);
     if (rows == self->rows && cols == self->cols)
     {
-      uint32 x = 0, y = 0;
-      uint32 val1 = 0, val2 = 0;
-      ret = true;
-      for (x = 0; x < self->cols; x++)
+      ret = (memcmp(&self->cells, &other->cells, sizeof(self->cells)) == 0);
+    }
+  }
+
+  return ret;
+}
+
+uint64 board_get_hash(board *self)
+{
+  uint64 hash = 0;
+
+  if (self != NULL)
+  {
+    hash = self->hash;
+  }
+
+  return hash;
+}
+
+bool board_is_bitboard(board *self)
+{
+  return (self != NULL && self->kernel == &board_kernel_bits) ? true : false;
+}
+
+bitboard board_get_bitboard(board *self)
+{
+  bitboard b = 0;
+
+  if (board_is_bitboard(self) == true)
+  {
+    b = self->cells.bits;
+  }
+
+  return b;
+}
+
+void board_set_bitboard(board *self, bitboard b)
+{
+  if (board_is_bitboard(self) == true)
+  {
+    self->hash = bitboard_hash_update(self->hash, self->cells.bits, b);
+    self->cells.bits = b;
+  }
+}
+
+bool board_move(board *self, board *next, enum direction dir, uint64 *score)
+{
+  bool ret = false;
+
+  *score = 0;
+  if (self != NULL && next != NULL && dir < BOTTOM_OF_DIRECTION
+    && self->rows == next->rows && self->cols == next->cols)
+  {
+    ret = self->kernel->move(self, next, dir, score);
+    board_rehash(next);
+  }
+
+  return ret;
+}
+
+uint32 board_legal_moves(board *self)
+{
+  uint32 mask = 0;
+
+  if (self != NULL)
+  {
+    mask = self->kernel->legal_moves(self);
+  }
+
+  return mask;
+}
+
+/*
+ * Slide a line of exponents towards its head.  A pair of tiles at max
+ * would overflow the cell, so it stays as it is.
+ */
+bool board_slide_line(uint32 *line, uint32 len, uint32 max, uint32 *merged)
+{
+  bool ret = false;
+  uint32 i = 0, j = 0;
+
+  /* merge the first pair of equal tiles, only one merge per line */
+  *merged = 0;
+  for (i = 0; i < len - 1 && *merged == 0; i++)
+  {
+    if (line[i] != 0)
+    {
+      for (j = i + 1; j < len; j++)
       {
-        for (y = 0; y < self->rows; y++)
+        if (line[j] == 0)
+        {
+          continue;
+        }
+        else if (line[i] == line[j] && line[i] < max)
         {
-          val1 = board_get_value(self, x, y);
-          val2 = board_get_value(other, x, y);
-          ret &= (val1 == val2);
+          line[i]++;
+          line[j] = 0;
+          *merged = line[i];
+          ret = true;
         }
+        break;
+      }
+    }
+  }
+
+  /* then slide every tile towards the head of the line */
+  for (i = j = 0; i < len; i++)
+  {
+    if (line[i] != 0)
+    {
+      if (i != j)
+      {
+        ret = true;
       }
+      line[j++] = line[i];
     }
   }
+  for (; j < len; j++)
+  {
+    line[j] = 0;
+  }
 
   return ret;
 }
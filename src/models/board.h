@@ -2,6 +2,7 @@
 #define __BOARD_H__
 
 #include "constants.h"
+#include "bitboard.h"
 
 typedef struct _board board;
 
@@ -12,8 +13,15 @@ uint32 board_get_cols(board *self);
 void board_set_value(board *self, uint32 x, uint32 y, uint32 val);
 void board_set_value_by_pos(board *self, uint64 pos, uint32 val);
 uint32 board_get_value(board *self, uint32 x, uint32 y);
-void board_get_empty(board *self, uint64 **array, uint32 *len);
+void board_get_empty(board *self, uint64 *array, uint32 *len);
 bool board_clone_data(board *self, board *mother);
 bool board_is_equal(board *self, board *other);
+uint64 board_get_hash(board *self);
+bool board_is_bitboard(board *self);
+bitboard board_get_bitboard(board *self);
+void board_set_bitboard(board *self, bitboard b);
+bool board_move(board *self, board *next, enum direction dir, uint64 *score);
+uint32 board_legal_moves(board *self);
+bool board_slide_line(uint32 *line, uint32 len, uint32 max, uint32 *merged);
 
 #endif /* __BOARD_H__ */
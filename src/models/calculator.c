@@ -1,21 +1,41 @@
 #include <stdlib.h>
 #include "calculator.h"
+#include "calculator_sse.h"
+
+typedef bitboard (*calculator_move_kernel)(bitboard b, enum direction dir,
+  uint64 *score);
 
 typedef struct _calculator
 {
-  uint64 score;
-  board *temp;
+  uint64                  score;
+  enum calculator_kernel  kernel;
+  calculator_move_kernel  move;
+  bool                    batch_avx2;
 } calculator;
 
-static bool calculator_move_up(calculator *self, board *c, board *n, bool only_check);
-static bool calculator_move_down(calculator *self, board *c, board *n, bool only_check);
-static bool calculator_move_left(calculator *self, board *c, board *n, bool only_check);
-static bool calculator_move_right(calculator *self, board *c, board *n, bool only_check);
-static bool calculator_proc_line(calculator *self, uint32 *array, size_t len,
-                                 bool only_check);
-static bool calculator_merge_array(calculator *self, uint32 *array, size_t len,
-                                   bool only_check);
-static bool calculator_move_array(calculator *self, uint32 *array, size_t len);
+/*
+ * Every 16-bit row maps to one table entry per side: the low 16 bits hold
+ * the row after sliding towards that side, the next bits hold the exponent
+ * of the merged tile (0 when nothing merged).  A line merges at most once
+ * per move, so that exponent is enough to recover the score gain.
+ */
+#define ROW_TABLE_SIZE          (BITBOARD_ROW_MASK + 1)
+#define ROW_ENTRY_RESULT(e)     ((e) & BITBOARD_ROW_MASK)
+#define ROW_ENTRY_MERGED(e)     ((e) >> BITBOARD_ROW_BITS)
+
+enum row_side
+{
+  ROW_TO_HEAD           = 0,    /* LEFT, or UP on the transposed board */
+  ROW_TO_TAIL           = 1,    /* RIGHT, or DOWN on the transposed board */
+  BOTTOM_OF_ROW_SIDE
+};
+
+static uint32 row_table[BOTTOM_OF_ROW_SIDE][ROW_TABLE_SIZE];
+
+static bitboard calculator_table_move(bitboard b, enum direction dir,
+                                      uint64 *score);
+static bitboard calculator_move_rows(bitboard b, enum row_side side,
+                                     uint64 *score);
 
 bool calculator_create(calculator **self)
 {
@@ -24,7 +44,13 @@ bool calculator_create(calculator **self)
   *self = (calculator *)malloc(sizeof(calculator));
   if (*self != NULL)
   {
-    ret = board_create(&(*self)->temp, ROWS_OF_BOARD, COLS_OF_BOARD);
+    (*self)->score = 0;
+    (*self)->batch_avx2 = calculator_avx2_supported();
+    if (calculator_set_kernel(*self, CALCULATOR_KERNEL_SSE) == false)
+    {
+      calculator_set_kernel(*self, CALCULATOR_KERNEL_TABLE);
+    }
+    ret = true;
   }
 
   return ret;
@@ -34,282 +60,335 @@ void calculator_destory(calculator **self)
 {
   if (*self != NULL)
   {
-    board_destory(&(*self)->temp);
     free(*self);
     *self = NULL;
   }
 }
 
-bool calculator_check_direction(calculator *self, board *b, enum direction dir)
+/*
+ * A line can slide towards a side when an empty cell sits right before a
+ * tile on that side, and can merge either way when two equal tiles touch,
+ * unless they are 32768s.  All pairs of neighbours are tested at once on
+ * the nibble flags, so no successor board is built.
+ */
+uint32 calculator_legal_moves(calculator *self, bitboard b)
 {
-  bool ret = false;
+  /* cells with a right hand neighbour, and cells with one below */
+  const bitboard horizontal = 0x0111011101110111ULL;
+  const bitboard vertical = 0x0000111111111111ULL;
+  bitboard occupied = 0, empty = 0, same = 0, top = 0;
+  uint32 mask = 0;
 
-  if (self != NULL)
+  if (self == NULL)
   {
-    switch (dir)
-    {
-      case UP:
-        ret = calculator_move_up(self, b, self->temp, true);
-        break;
-      case DOWN:
-        ret = calculator_move_down(self, b, self->temp, true);
-        break;
-      case LEFT:
-        ret = calculator_move_left(self, b, self->temp, true);
-        break;
-      case RIGHT:
-        ret = calculator_move_right(self, b, self->temp, true);
-        break;
-      default:
-        break;
-    }
+    return mask;
   }
 
-  return ret;
-}
+  occupied = bitboard_occupied(b);
+  empty = occupied ^ 0x1111111111111111ULL;
+  /* cells at BITBOARD_MAX_EXPONENT, they never merge */
+  top = b & (b >> 1) & (b >> 2) & (b >> 3) & 0x1111111111111111ULL;
 
-bool calculator_move(calculator *self, board *current, board *next, enum direction dir)
-{
-  bool ret = false;
+  same = ~bitboard_occupied(b ^ (b >> BITBOARD_CELL_BITS)) & occupied & horizontal;
+  same &= ~top;
+  if (same != 0)
+  {
+    mask |= CALCULATOR_MOVE_BIT(LEFT) | CALCULATOR_MOVE_BIT(RIGHT);
+  }
+  else
+  {
+    if ((empty & (occupied >> BITBOARD_CELL_BITS) & horizontal) != 0)
+    {
+      mask |= CALCULATOR_MOVE_BIT(LEFT);
+    }
+    if ((occupied & (empty >> BITBOARD_CELL_BITS) & horizontal) != 0)
+    {
+      mask |= CALCULATOR_MOVE_BIT(RIGHT);
+    }
+  }
 
-  if (self != NULL && current != NULL && next != NULL)
+  same = ~bitboard_occupied(b ^ (b >> BITBOARD_ROW_BITS)) & occupied & vertical;
+  same &= ~top;
+  if (same != 0)
   {
-    switch (dir)
+    mask |= CALCULATOR_MOVE_BIT(UP) | CALCULATOR_MOVE_BIT(DOWN);
+  }
+  else
+  {
+    if ((empty & (occupied >> BITBOARD_ROW_BITS) & vertical) != 0)
     {
-      case UP:
-        ret = calculator_move_up(self, current, next, false);
-        break;
-      case DOWN:
-        ret = calculator_move_down(self, current, next, false);
-        break;
-      case LEFT:
-        ret = calculator_move_left(self, current, next, false);
-        break;
-      case RIGHT:
-        ret = calculator_move_right(self, current, next, false);
-        break;
-      default:
-        break;
+      mask |= CALCULATOR_MOVE_BIT(UP);
+    }
+    if ((occupied & (empty >> BITBOARD_ROW_BITS) & vertical) != 0)
+    {
+      mask |= CALCULATOR_MOVE_BIT(DOWN);
     }
   }
 
-  return ret;
+  return mask;
 }
 
-uint64 calculator_get_score(calculator *self)
+bool calculator_move(calculator *self, bitboard current, bitboard *next,
+  enum direction dir)
 {
-  uint64 ret = 0;
-  if (self != NULL)
+  bool ret = false;
+  uint64 score = 0;
+
+  if (self != NULL && next != NULL && dir < BOTTOM_OF_DIRECTION)
   {
-    ret = self->score;
+    *next = self->move(current, dir, &score);
+    self->score += score;
+    ret = *next != current;
   }
+
   return ret;
 }
 
-static bool calculator_move_up(calculator *self, board *c, board *n, bool only_check)
+/* next_hash is hash with only the cells the move touched rekeyed */
+bool calculator_move_with_hash(calculator *self, bitboard current, uint64 hash,
+  bitboard *next, uint64 *next_hash, enum direction dir)
 {
   bool ret = false;
-  uint32 cols = board_get_cols(c);
-  uint32 rows = board_get_rows(c);
-  uint32 x = 0, y = 0;
-  uint32 val = 0;
-  uint32 *val_array = NULL;
-
-  val_array = (uint32 *)malloc(sizeof(uint32) * rows);
-  if (val_array != NULL)
+
+  ret = calculator_move(self, current, next, dir);
+  if (ret == true && next_hash != NULL)
   {
-    for (x = 0; x < cols; x++)
-    {
-      for (y = 0; y < rows; y++)
-      {
-        val = board_get_value(c, x, y);
-        val_array[y] = val;
-      }
-      ret |= calculator_proc_line(self, val_array, rows, only_check);
-      for (y = 0; y < rows; y++)
-      {
-        val = val_array[y];
-        board_set_value(n, x, y, val);
-      }
-    }
-    free(val_array);
+    *next_hash = bitboard_hash_update(hash, current, *next);
+  }
+  else if (next_hash != NULL)
+  {
+    *next_hash = hash;
   }
 
   return ret;
 }
 
-static bool calculator_move_down(calculator *self, board *c, board *n, bool only_check)
+/*
+ * Move in[0..n) one way into out.  changed must hold (n + 63) / 64 words
+ * and gets bit i set when board i moved; the count of those is returned.
+ * With AVX2 the boards go four at a time and the rest through the single
+ * board kernel.
+ */
+uint32 calculator_move_batch(calculator *self, const bitboard *in,
+  bitboard *out, uint32 n, enum direction dir, uint64 *changed)
 {
-  bool ret = false;
-  uint32 cols = board_get_cols(c);
-  uint32 rows = board_get_rows(c);
-  uint32 x = 0, y = 0;
-  uint32 val = 0;
-  uint32 *val_array = NULL;
-
-  val_array = (uint32 *)malloc(sizeof(uint32) * rows);
-  if (val_array != NULL)
+  uint32 i = 0, count = 0;
+  uint64 score = 0, gain = 0;
+
+  if (self == NULL || in == NULL || out == NULL || dir >= BOTTOM_OF_DIRECTION)
+  {
+    return count;
+  }
+
+  if (self->batch_avx2 == true)
+  {
+    i = calculator_avx2_move_batch(in, out, n, dir, &score);
+  }
+  for (; i < n; i++)
+  {
+    out[i] = self->move(in[i], dir, &gain);
+    score += gain;
+  }
+  self->score += score;
+
+  if (changed != NULL)
   {
-    for (x = 0; x < cols; x++)
+    for (i = 0; i < (n + 63) / 64; i++)
     {
-      for (y = rows - 1; y != ~0; y--)
-      {
-        val = board_get_value(c, x, y);
-        val_array[rows - y - 1] = val;
-      }
-      ret |= calculator_proc_line(self, val_array, rows, only_check);
-      for (y = rows - 1; y != ~0; y--)
+      changed[i] = 0;
+    }
+  }
+  for (i = 0; i < n; i++)
+  {
+    if (out[i] != in[i])
+    {
+      count++;
+      if (changed != NULL)
       {
-        val = val_array[rows - y - 1];
-        board_set_value(n, x, y, val);
+        changed[i / 64] |= (uint64)1 << (i % 64);
       }
     }
-    free(val_array);
   }
 
-  return ret;
+  return count;
 }
 
-static bool calculator_move_left(calculator *self, board *c, board *n, bool only_check)
+/* bitboards take the fast kernels, other shapes the board's own engine */
+bool calculator_move_board(calculator *self, board *current, board *next,
+  enum direction dir)
 {
   bool ret = false;
-  uint32 cols = board_get_cols(c);
-  uint32 rows = board_get_rows(c);
-  uint32 x = 0, y = 0;
-  uint32 val = 0;
-  uint32 *val_array = NULL;
-
-  val_array = (uint32 *)malloc(sizeof(uint32) * cols);
-  if (val_array != NULL)
+  bitboard bits = 0;
+  uint64 score = 0;
+
+  if (self != NULL)
   {
-    for (y = 0; y < rows; y++)
+    if (board_is_bitboard(current) == true && board_is_bitboard(next) == true)
     {
-      for (x = 0; x < cols; x++)
-      {
-        val = board_get_value(c, x, y);
-        val_array[x] = val;
-      }
-      ret |= calculator_proc_line(self, val_array, cols, only_check);
-      for (x = 0; x < cols; x++)
-      {
-        val = val_array[x];
-        board_set_value(n, x, y, val);
-      }
+      ret = calculator_move(self, board_get_bitboard(current), &bits, dir);
+      board_set_bitboard(next, bits);
+    }
+    else
+    {
+      ret = board_move(current, next, dir, &score);
+      self->score += score;
     }
-    free(val_array);
   }
 
   return ret;
 }
 
-static bool calculator_move_right(calculator *self, board *c, board *n, bool only_check)
+uint32 calculator_legal_moves_board(calculator *self, board *b)
 {
-  bool ret = false;
-  uint32 cols = board_get_cols(c);
-  uint32 rows = board_get_rows(c);
-  uint32 x = 0, y = 0;
-  uint32 val = 0;
-  uint32 *val_array = NULL;
-
-  val_array = (uint32 *)malloc(sizeof(uint32) * cols);
-  if (val_array != NULL)
+  uint32 mask = 0;
+
+  if (self != NULL)
   {
-    for (y = 0; y < rows; y++)
+    if (board_is_bitboard(b) == true)
     {
-      for (x = cols - 1; x != ~0; x--)
-      {
-        val = board_get_value(c, x, y);
-        val_array[cols - x - 1] = val;
-      }
-      ret |= calculator_proc_line(self, val_array, cols, only_check);
-      for (x = cols - 1; x != ~0; x--)
-      {
-        val = val_array[cols - x - 1];
-        board_set_value(n, x, y, val);
-      }
+      mask = calculator_legal_moves(self, board_get_bitboard(b));
+    }
+    else
+    {
+      mask = board_legal_moves(b);
     }
-    free(val_array);
   }
 
-  return ret;
+  return mask;
 }
 
-static bool calculator_proc_line(calculator *self, uint32 *array, size_t len,
-                                 bool only_check)
+uint64 calculator_get_score(calculator *self)
 {
-  bool ret = false;
-
-  ret = calculator_merge_array(self, array, len, only_check);
-  ret |= calculator_move_array(self, array, len);
-
+  uint64 ret = 0;
+  if (self != NULL)
+  {
+    ret = self->score;
+  }
   return ret;
 }
 
-static bool calculator_merge_array(calculator *self, uint32 *array, size_t len,
-                                   bool only_check)
+bool calculator_set_kernel(calculator *self, enum calculator_kernel kernel)
 {
   bool ret = false;
-  uint32 i = 0, j = 0;
 
-  for (i = 0; i < len - 1; i++)
+  if (self != NULL)
   {
-    if (array[i] != 0)
+    switch (kernel)
     {
-      for (j = i + 1; j < len; j++)
-      {
-        if (array[j] == 0)
-        {
-          continue;
-        }
-        else if (array[i] != array[j])
-        {
-          break;
-        }
-        else
+      case CALCULATOR_KERNEL_TABLE:
+        self->move = calculator_table_move;
+        ret = true;
+        break;
+      case CALCULATOR_KERNEL_SSE:
+        if (calculator_sse_supported() == true)
         {
-          array[i] += array[j];
-          array[j] = 0;
+          self->move = calculator_sse_move;
           ret = true;
-          if (only_check == false)
-          {
-            self->score += array[i];
-          }
-          break;
         }
-      }
-      if (ret == true)
-      {
         break;
-      }
+      default:
+        break;
+    }
+    if (ret == true)
+    {
+      self->kernel = kernel;
     }
   }
 
   return ret;
 }
 
-static bool calculator_move_array(calculator *self, uint32 *array, size_t len)
+enum calculator_kernel calculator_get_kernel(calculator *self)
 {
-  bool ret = false;
-  uint32 i = 0, j = 0;
+  enum calculator_kernel kernel = BOTTOM_OF_CALCULATOR_KERNEL;
 
-  for (i = j = 0; i < len; i++)
+  if (self != NULL)
   {
-    if (array[i] != 0)
-    {
-      if (i != j)
-      {
-        ret = true;
-      }
-      array[j++] = array[i];
-    }
+    kernel = self->kernel;
   }
 
-  if (i != j)
+  return kernel;
+}
+
+/* filled before main runs, so threads creating calculators share it */
+static void __attribute__((constructor)) calculator_init_row_table(void)
+{
+  uint32 row = 0, i = 0;
+  uint32 merged = 0;
+  uint32 line[BITBOARD_COLS];
+
+  for (row = 0; row < ROW_TABLE_SIZE; row++)
   {
-    for (; j < len; j++)
+    for (i = 0; i < BITBOARD_COLS; i++)
+    {
+      line[i] = (row >> (i * BITBOARD_CELL_BITS)) & BITBOARD_CELL_MASK;
+    }
+    board_slide_line(line, BITBOARD_COLS, BITBOARD_MAX_EXPONENT, &merged);
+    row_table[ROW_TO_HEAD][row] = merged << BITBOARD_ROW_BITS;
+    for (i = 0; i < BITBOARD_COLS; i++)
+    {
+      row_table[ROW_TO_HEAD][row] |=
+        (line[i] & BITBOARD_CELL_MASK) << (i * BITBOARD_CELL_BITS);
+    }
+
+    for (i = 0; i < BITBOARD_COLS; i++)
+    {
+      line[BITBOARD_COLS - i - 1] =
+        (row >> (i * BITBOARD_CELL_BITS)) & BITBOARD_CELL_MASK;
+    }
+    board_slide_line(line, BITBOARD_COLS, BITBOARD_MAX_EXPONENT, &merged);
+    row_table[ROW_TO_TAIL][row] = merged << BITBOARD_ROW_BITS;
+    for (i = 0; i < BITBOARD_COLS; i++)
     {
-      array[j] = 0;
+      row_table[ROW_TO_TAIL][row] |=
+        (line[BITBOARD_COLS - i - 1] & BITBOARD_CELL_MASK)
+        << (i * BITBOARD_CELL_BITS);
     }
   }
-  return ret;
+}
+
+static bitboard calculator_table_move(bitboard b, enum direction dir,
+                                      uint64 *score)
+{
+  bitboard n = b;
+
+  *score = 0;
+  switch (dir)
+  {
+    case UP:
+      n = bitboard_transpose(
+        calculator_move_rows(bitboard_transpose(b), ROW_TO_HEAD, score));
+      break;
+    case DOWN:
+      n = bitboard_transpose(
+        calculator_move_rows(bitboard_transpose(b), ROW_TO_TAIL, score));
+      break;
+    case LEFT:
+      n = calculator_move_rows(b, ROW_TO_HEAD, score);
+      break;
+    case RIGHT:
+      n = calculator_move_rows(b, ROW_TO_TAIL, score);
+      break;
+    default:
+      break;
+  }
+
+  return n;
+}
+
+static bitboard calculator_move_rows(bitboard b, enum row_side side,
+                                     uint64 *score)
+{
+  uint32 y = 0;
+  uint32 entry = 0;
+  bitboard result = 0;
+
+  for (y = 0; y < BITBOARD_ROWS; y++)
+  {
+    entry = row_table[side][bitboard_get_row(b, y)];
+    result |= (bitboard)ROW_ENTRY_RESULT(entry) << (y * BITBOARD_ROW_BITS);
+    *score += bitboard_exponent_to_value(ROW_ENTRY_MERGED(entry));
+  }
+
+  return result;
 }
@@ -2,14 +2,34 @@
 #define __CALCULATOR_H__
 
 #include "constants.h"
+#include "bitboard.h"
 #include "board.h"
 
 typedef struct _calculator calculator;
 
+#define CALCULATOR_MOVE_BIT(dir)    (1U << (dir))
+
+enum calculator_kernel
+{
+  CALCULATOR_KERNEL_TABLE     = 0,
+  CALCULATOR_KERNEL_SSE       = 1,
+  BOTTOM_OF_CALCULATOR_KERNEL
+};
+
 bool calculator_create(calculator **self);
 void calculator_destory(calculator **self);
-bool calculator_check_direction(calculator *self, board *b, enum direction dir);
-bool calculator_move(calculator *self, board *current, board *next, enum direction dir);
+uint32 calculator_legal_moves(calculator *self, bitboard b);
+bool calculator_move(calculator *self, bitboard current, bitboard *next,
+  enum direction dir);
+bool calculator_move_with_hash(calculator *self, bitboard current, uint64 hash,
+  bitboard *next, uint64 *next_hash, enum direction dir);
+uint32 calculator_move_batch(calculator *self, const bitboard *in,
+  bitboard *out, uint32 n, enum direction dir, uint64 *changed);
+bool calculator_move_board(calculator *self, board *current, board *next,
+  enum direction dir);
+uint32 calculator_legal_moves_board(calculator *self, board *b);
 uint64 calculator_get_score(calculator *self);
+bool calculator_set_kernel(calculator *self, enum calculator_kernel kernel);
+enum calculator_kernel calculator_get_kernel(calculator *self);
 
 #endif /* __CALCULATOR_H__ */
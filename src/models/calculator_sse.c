@@ -0,0 +1,275 @@
+#include "calculator_sse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+/*
+ * The board is unpacked into one exponent byte per cell, row y in bytes
+ * [4 * y, 4 * y + 4).  Every direction is turned into LEFT with a constant
+ * byte shuffle, all four rows slide at once, and the inverse shuffle puts
+ * the board back.  Merging follows the table engine: only the first pair
+ * of equal neighbours in a line merges, and never two 32768 tiles.
+ */
+#define SSE_TARGET  __attribute__((target("ssse3")))
+
+static const uint8 forward_shuffle[BOTTOM_OF_DIRECTION][16] __attribute__((aligned(16))) =
+{
+  {0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15},   /* UP */
+  {12, 8, 4, 0, 13, 9, 5, 1, 14, 10, 6, 2, 15, 11, 7, 3},   /* DOWN */
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},   /* LEFT */
+  {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12}    /* RIGHT */
+};
+
+static const uint8 backward_shuffle[BOTTOM_OF_DIRECTION][16] __attribute__((aligned(16))) =
+{
+  {0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15},
+  {3, 7, 11, 15, 2, 6, 10, 14, 1, 5, 9, 13, 0, 4, 8, 12},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+  {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12}
+};
+
+bool calculator_sse_supported(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3") ? true : false;
+}
+
+/* drop the first empty cell of every row, shifting the rest of it left */
+static inline SSE_TARGET __m128i calculator_sse_squeeze(__m128i v,
+  __m128i from1, __m128i from2, __m128i from3, __m128i head)
+{
+  __m128i z = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+  __m128i p = z;
+  __m128i next = _mm_and_si128(_mm_srli_si128(v, 1), head);
+
+  p = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(z, 1), from1));
+  p = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(z, 2), from2));
+  p = _mm_or_si128(p, _mm_and_si128(_mm_slli_si128(z, 3), from3));
+
+  return _mm_or_si128(_mm_and_si128(p, next), _mm_andnot_si128(p, v));
+}
+
+SSE_TARGET bitboard calculator_sse_move(bitboard b, enum direction dir,
+  uint64 *score)
+{
+  const __m128i low = _mm_set1_epi8(0x0F);
+  /* byte lanes whose position inside their row is at least 1, 2, 3 */
+  const __m128i from1 = _mm_set1_epi32((int)0xFFFFFF00);
+  const __m128i from2 = _mm_set1_epi32((int)0xFFFF0000);
+  const __m128i from3 = _mm_set1_epi32((int)0xFF000000);
+  const __m128i head = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i top = _mm_set1_epi8(BITBOARD_MAX_EXPONENT);
+  __m128i packed, v, next, eq, before, first, merged, gain;
+
+  *score = 0;
+  if (dir >= BOTTOM_OF_DIRECTION)
+  {
+    return b;
+  }
+
+  /* one exponent byte per cell */
+  packed = _mm_loadl_epi64((const __m128i *)&b);
+  v = _mm_unpacklo_epi8(_mm_and_si128(packed, low),
+    _mm_and_si128(_mm_srli_epi16(packed, 4), low));
+  v = _mm_shuffle_epi8(v,
+    _mm_load_si128((const __m128i *)forward_shuffle[dir]));
+
+  /* slide: a row holds at most three holes */
+  v = calculator_sse_squeeze(v, from1, from2, from3, head);
+  v = calculator_sse_squeeze(v, from1, from2, from3, head);
+  v = calculator_sse_squeeze(v, from1, from2, from3, head);
+
+  /* merge the first pair of equal neighbours in every row */
+  next = _mm_and_si128(_mm_srli_si128(v, 1), head);
+  eq = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+    _mm_cmpeq_epi8(v, top)), _mm_and_si128(_mm_cmpeq_epi8(v, next), head));
+  before = _mm_and_si128(_mm_slli_si128(eq, 1), from1);
+  before = _mm_or_si128(before, _mm_and_si128(_mm_slli_si128(eq, 2), from2));
+  before = _mm_or_si128(before, _mm_and_si128(_mm_slli_si128(eq, 3), from3));
+  first = _mm_andnot_si128(before, eq);
+  v = _mm_sub_epi8(v, first);
+  v = _mm_andnot_si128(_mm_slli_si128(first, 1), v);
+
+  /* every row merged at most once: gather the new exponent per row and
+   * raise 2 to it through the float exponent field */
+  merged = _mm_and_si128(first, v);
+  merged = _mm_or_si128(merged, _mm_srli_epi32(merged, 8));
+  merged = _mm_or_si128(merged, _mm_srli_epi32(merged, 16));
+  merged = _mm_and_si128(merged, _mm_set1_epi32(0xFF));
+  gain = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(
+    _mm_add_epi32(merged, _mm_set1_epi32(127)), 23)));
+  gain = _mm_andnot_si128(_mm_cmpeq_epi32(merged, _mm_setzero_si128()), gain);
+  gain = _mm_add_epi32(gain, _mm_shuffle_epi32(gain, _MM_SHUFFLE(1, 0, 3, 2)));
+  gain = _mm_add_epi32(gain, _mm_shuffle_epi32(gain, _MM_SHUFFLE(2, 3, 0, 1)));
+  *score = (uint32)_mm_cvtsi128_si32(gain);
+  v = calculator_sse_squeeze(v, from1, from2, from3, head);
+
+  /* back to nibbles */
+  v = _mm_shuffle_epi8(v,
+    _mm_load_si128((const __m128i *)backward_shuffle[dir]));
+  v = _mm_and_si128(v, low);
+  v = _mm_maddubs_epi16(v, _mm_set1_epi16(0x1001));
+  v = _mm_packus_epi16(v, v);
+  _mm_storel_epi64((__m128i *)&b, v);
+
+  return b;
+}
+
+/*
+ * The AVX2 batch runs the same algorithm with one board per 128-bit lane,
+ * two boards per register and two registers per step, so four boards go
+ * through every instruction stream.
+ */
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+bool calculator_avx2_supported(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? true : false;
+}
+
+static inline AVX2_TARGET __m256i calculator_avx2_squeeze(__m256i v,
+  __m256i from1, __m256i from2, __m256i from3, __m256i head)
+{
+  __m256i z = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+  __m256i p = z;
+  __m256i next = _mm256_and_si256(_mm256_srli_si256(v, 1), head);
+
+  p = _mm256_or_si256(p, _mm256_and_si256(_mm256_slli_si256(z, 1), from1));
+  p = _mm256_or_si256(p, _mm256_and_si256(_mm256_slli_si256(z, 2), from2));
+  p = _mm256_or_si256(p, _mm256_and_si256(_mm256_slli_si256(z, 3), from3));
+
+  return _mm256_or_si256(_mm256_and_si256(p, next), _mm256_andnot_si256(p, v));
+}
+
+/* slide two boards, one per lane, and add their score gain to *gain */
+static inline AVX2_TARGET __m256i calculator_avx2_slide(__m256i v,
+  __m256i *gain)
+{
+  const __m256i from1 = _mm256_set1_epi32((int)0xFFFFFF00);
+  const __m256i from2 = _mm256_set1_epi32((int)0xFFFF0000);
+  const __m256i from3 = _mm256_set1_epi32((int)0xFF000000);
+  const __m256i head = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i top = _mm256_set1_epi8(BITBOARD_MAX_EXPONENT);
+  __m256i next, eq, before, first, merged, g;
+
+  v = calculator_avx2_squeeze(v, from1, from2, from3, head);
+  v = calculator_avx2_squeeze(v, from1, from2, from3, head);
+  v = calculator_avx2_squeeze(v, from1, from2, from3, head);
+
+  next = _mm256_and_si256(_mm256_srli_si256(v, 1), head);
+  eq = _mm256_andnot_si256(_mm256_or_si256(
+    _mm256_cmpeq_epi8(v, _mm256_setzero_si256()), _mm256_cmpeq_epi8(v, top)),
+    _mm256_and_si256(_mm256_cmpeq_epi8(v, next), head));
+  before = _mm256_and_si256(_mm256_slli_si256(eq, 1), from1);
+  before = _mm256_or_si256(before,
+    _mm256_and_si256(_mm256_slli_si256(eq, 2), from2));
+  before = _mm256_or_si256(before,
+    _mm256_and_si256(_mm256_slli_si256(eq, 3), from3));
+  first = _mm256_andnot_si256(before, eq);
+  v = _mm256_sub_epi8(v, first);
+  v = _mm256_andnot_si256(_mm256_slli_si256(first, 1), v);
+
+  merged = _mm256_and_si256(first, v);
+  merged = _mm256_or_si256(merged, _mm256_srli_epi32(merged, 8));
+  merged = _mm256_or_si256(merged, _mm256_srli_epi32(merged, 16));
+  merged = _mm256_and_si256(merged, _mm256_set1_epi32(0xFF));
+  g = _mm256_sllv_epi32(_mm256_set1_epi32(1), merged);
+  g = _mm256_andnot_si256(_mm256_cmpeq_epi32(merged, _mm256_setzero_si256()), g);
+  *gain = _mm256_add_epi32(*gain, g);
+
+  return calculator_avx2_squeeze(v, from1, from2, from3, head);
+}
+
+static inline AVX2_TARGET __m256i calculator_avx2_unpack(const bitboard *in,
+  __m256i forward)
+{
+  const __m256i low = _mm256_set1_epi8(0x0F);
+  __m256i packed = _mm256_permute4x64_epi64(_mm256_castsi128_si256(
+    _mm_loadu_si128((const __m128i *)in)), 0x50);
+  __m256i v = _mm256_unpacklo_epi8(_mm256_and_si256(packed, low),
+    _mm256_and_si256(_mm256_srli_epi16(packed, 4), low));
+
+  return _mm256_shuffle_epi8(v, forward);
+}
+
+static inline AVX2_TARGET void calculator_avx2_pack(bitboard *out, __m256i v,
+  __m256i backward)
+{
+  v = _mm256_shuffle_epi8(v, backward);
+  v = _mm256_and_si256(v, _mm256_set1_epi8(0x0F));
+  v = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x1001));
+  v = _mm256_packus_epi16(v, v);
+  v = _mm256_permute4x64_epi64(v, 0x08);
+  _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(v));
+}
+
+AVX2_TARGET uint32 calculator_avx2_move_batch(const bitboard *in,
+  bitboard *out, uint32 n, enum direction dir, uint64 *score)
+{
+  __m256i forward, backward, gain, total = _mm256_setzero_si256();
+  __m256i v0, v1;
+  __m128i sum;
+  uint32 i = 0;
+
+  *score = 0;
+  if (dir >= BOTTOM_OF_DIRECTION)
+  {
+    return 0;
+  }
+
+  forward = _mm256_broadcastsi128_si256(
+    _mm_load_si128((const __m128i *)forward_shuffle[dir]));
+  backward = _mm256_broadcastsi128_si256(
+    _mm_load_si128((const __m128i *)backward_shuffle[dir]));
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    gain = _mm256_setzero_si256();
+    v0 = calculator_avx2_unpack(in + i, forward);
+    v1 = calculator_avx2_unpack(in + i + 2, forward);
+    v0 = calculator_avx2_slide(v0, &gain);
+    v1 = calculator_avx2_slide(v1, &gain);
+    calculator_avx2_pack(out + i, v0, backward);
+    calculator_avx2_pack(out + i + 2, v1, backward);
+    /* one step stays well inside 32 bits, the whole batch may not */
+    total = _mm256_add_epi64(total,
+      _mm256_cvtepu32_epi64(_mm256_castsi256_si128(gain)));
+    total = _mm256_add_epi64(total,
+      _mm256_cvtepu32_epi64(_mm256_extracti128_si256(gain, 1)));
+  }
+
+  sum = _mm_add_epi64(_mm256_castsi256_si128(total),
+    _mm256_extracti128_si256(total, 1));
+  sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+  _mm_storel_epi64((__m128i *)score, sum);
+
+  return i;
+}
+
+#else
+
+bool calculator_sse_supported(void)
+{
+  return false;
+}
+
+bool calculator_avx2_supported(void)
+{
+  return false;
+}
+
+uint32 calculator_avx2_move_batch(const bitboard *in, bitboard *out, uint32 n,
+  enum direction dir, uint64 *score)
+{
+  *score = 0;
+  return 0;
+}
+
+bitboard calculator_sse_move(bitboard b, enum direction dir, uint64 *score)
+{
+  *score = 0;
+  return b;
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __CALCULATOR_SSE_H__
+#define __CALCULATOR_SSE_H__
+
+#include "constants.h"
+#include "bitboard.h"
+
+bool calculator_sse_supported(void);
+bitboard calculator_sse_move(bitboard b, enum direction dir, uint64 *score);
+bool calculator_avx2_supported(void);
+uint32 calculator_avx2_move_batch(const bitboard *in, bitboard *out, uint32 n,
+  enum direction dir, uint64 *score);
+
+#endif /* __CALCULATOR_SSE_H__ */
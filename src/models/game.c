@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "game.h"
 #include "board.h"
@@ -31,7 +32,7 @@ static void game_init(game *self)
 {
   uint32 val = 0;
   uint64 val_array[] = GAME_NUBMER_ELEMENTS;
-  uint64 *pos_array = NULL;
+  uint64 pos_array[MAX_ROWS_OF_BOARD * MAX_COLS_OF_BOARD];
   uint32 pos_array_len = 0;
   uint64 pos = 0;
   int i = 0;
@@ -45,9 +46,8 @@ static void game_init(game *self)
     val_array[0] = val_array[0];
     val = GAME_INIT_NUMBER;
 #endif
-    board_get_empty(self->b[self->current_board], &pos_array, &pos_array_len);
+    board_get_empty(self->b[self->current_board], pos_array, &pos_array_len);
     pos = random_generator_select(self->rg, pos_array, pos_array_len);
-    free(pos_array);
     board_set_value_by_pos(self->b[self->current_board], pos, val);
   }
 #if defined(AUTO_PLAY) && !defined(THINKING_BY_DEPTH)
@@ -55,7 +55,7 @@ static void game_init(game *self)
 #endif
 }
 
-bool game_create(game **self)
+bool game_create(game **self, uint32 rows, uint32 cols)
 {
   bool ret = true;
   int i = 0;
@@ -65,7 +65,7 @@ bool game_create(game **self)
   {
     for (i = 0; i < ARRAY_SIZE((*self)->b); i++)
     {
-      ret &= board_create(&(*self)->b[i], ROWS_OF_BOARD, COLS_OF_BOARD);
+      ret &= board_create(&(*self)->b[i], rows, cols);
     }
 #if defined(AUTO_PLAY)
     ret &= ai_create(&(*self)->a);
@@ -89,6 +89,86 @@ bool game_create(game **self)
   return ret;
 }
 
+/* n-tuple weights for the ai, only meaningful when it plays */
+bool game_load_weights(game *self, const char *path)
+{
+  bool ret = false;
+
+#if defined(AUTO_PLAY)
+  if (self != NULL)
+  {
+    ret = ai_load_weights(self->a, path);
+  }
+#endif
+
+  return ret;
+}
+
+/* heuristic evaluator weights for the ai, as written by 2048_tune */
+bool game_set_weights(game *self, float smoothness, float monotonicity,
+  float empty, float max_value)
+{
+  bool ret = false;
+
+#if defined(AUTO_PLAY)
+  if (self != NULL)
+  {
+    ai_set_weights(self->a, smoothness, monotonicity, empty, max_value);
+    ret = true;
+  }
+#endif
+
+  return ret;
+}
+
+/* transposition table of the ai search, 0 for none */
+bool game_set_table_size(game *self, uint32 megabytes)
+{
+  bool ret = false;
+
+#if defined(AUTO_PLAY)
+  if (self != NULL)
+  {
+    ret = ai_set_table_size(self->a, megabytes);
+  }
+#endif
+
+  return ret;
+}
+
+/*
+ * the ai search by name: "minmax", "minmax-tree", "best-first" or
+ * "expectimax"
+ */
+bool game_set_engine(game *self, const char *name)
+{
+  bool ret = false;
+
+#if defined(AUTO_PLAY)
+  if (self != NULL && name != NULL)
+  {
+    if (strcmp(name, "minmax") == 0)
+    {
+      ret = ai_set_engine(self->a, AI_ENGINE_MINMAX);
+    }
+    else if (strcmp(name, "minmax-tree") == 0)
+    {
+      ret = ai_set_engine(self->a, AI_ENGINE_MINMAX_TREE);
+    }
+    else if (strcmp(name, "best-first") == 0)
+    {
+      ret = ai_set_engine(self->a, AI_ENGINE_BEST_FIRST);
+    }
+    else if (strcmp(name, "expectimax") == 0)
+    {
+      ret = ai_set_engine(self->a, AI_ENGINE_EXPECTIMAX);
+    }
+  }
+#endif
+
+  return ret;
+}
+
 void game_destory(game **self)
 {
   int i = 0;
@@ -134,7 +214,8 @@ void game_start(game *self)
         case LEFT:
         case RIGHT:
         case DOWN:
-          new_step = calculator_move(self->calc, self->b[current], self->b[next], dir);
+          new_step = calculator_move_board(self->calc, self->b[current],
+            self->b[next], dir);
           if (!new_step)
           {
             continue;
@@ -176,40 +257,25 @@ static void game_new_step(game *self)
 {
   uint32 val = 0;
   uint64 val_array[] = GAME_NUBMER_ELEMENTS;
-  uint64 *pos_array = NULL;
+  uint64 pos_array[MAX_ROWS_OF_BOARD * MAX_COLS_OF_BOARD];
   uint32 pos_array_len = 0;
   uint64 pos = 0;
 
-  board_get_empty(self->b[self->current_board], &pos_array, &pos_array_len);
+  board_get_empty(self->b[self->current_board], pos_array, &pos_array_len);
   if (pos_array_len > 0)
   {
     val = (uint32)random_generator_select(self->rg, val_array, ARRAY_SIZE(val_array));
     pos = random_generator_select(self->rg, pos_array, pos_array_len);
     board_set_value_by_pos(self->b[self->current_board], pos, val);
   }
-  free(pos_array);
 }
 
 static bool game_is_over(game *self)
 {
   bool ret = true;
-  uint64 *pos_array = NULL;
-  uint32 pos_array_len = 0;
   uint8 current = self->current_board;
 
-  board_get_empty(self->b[self->current_board], &pos_array, &pos_array_len);
-  free(pos_array);
-  if (pos_array_len == 0)
-  {
-    ret &= !calculator_check_direction(self->calc, self->b[current], UP);
-    ret &= !calculator_check_direction(self->calc, self->b[current], DOWN);
-    ret &= !calculator_check_direction(self->calc, self->b[current], LEFT);
-    ret &= !calculator_check_direction(self->calc, self->b[current], RIGHT);
-  }
-  else
-  {
-    ret = false;
-  }
+  ret = (calculator_legal_moves_board(self->calc, self->b[current]) == 0);
 
   /*
   uint32 x = 0, y = 0;
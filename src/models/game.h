@@ -5,8 +5,13 @@
 
 typedef struct _game game;
 
-bool game_create(game **self);
+bool game_create(game **self, uint32 rows, uint32 cols);
 void game_destory(game **self);
+bool game_load_weights(game *self, const char *path);
+bool game_set_weights(game *self, float smoothness, float monotonicity,
+  float empty, float max_value);
+bool game_set_table_size(game *self, uint32 megabytes);
+bool game_set_engine(game *self, const char *name);
 void game_start(game *self);
 
 #endif /* __GAME_H__ */
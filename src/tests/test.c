@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include "../ai/tree.h"
 #include "../ai/evaluator.h"
+#include "../ai/ntuple.h"
+#include "../ai/ttable.h"
+#include "../models/board.h"
+#include "../models/calculator.h"
 
 void data_free(void *owner, void *data)
 {
@@ -39,8 +43,10 @@ int main(int argc, char *argv[])
   printf("%u\n", tree_get_node_degree(t, node));
   printf("%u\n", tree_get_node_level(t, node));
   printf("%p\n", tree_find_node(t, &data[2]));
+  printf("%u\n", tree_get_size(t));
   tree_set_new_root(t, node);
   printf("%u\n", tree_get_depth(t));
+  printf("%u\n", tree_get_size(t));
   tree_destory(&t);
 
   board *b = NULL;
@@ -121,20 +127,265 @@ int main(int argc, char *argv[])
     board_set_value(b, 3, 3, 4);
 
     uint32 len = 0;
-    uint64 *pos_array = NULL;
-    board_get_empty(b, &pos_array, &len);
+    uint64 pos_array[ROWS_OF_BOARD * COLS_OF_BOARD];
+    board_get_empty(b, pos_array, &len);
     printf("empty count is %u\n", len);
-    free(pos_array);
-    printf("monotonicity is %d\n", evaluator_monotonicity(eval, b));
-    printf("smoothness is %d\n", evaluator_smoothness(eval, b));
-    printf("empty is %.13f\n", evaluator_empty(eval, b));
-    printf("max value is %u\n", evaluator_max_value(eval, b));
-    printf("islands is %u\n", evaluator_islands(eval, b));
-    printf("value is %.13f\n", evaluator_get_value(eval, b));
+    printf("monotonicity is %d\n", evaluator_monotonicity(eval, board_get_bitboard(b)));
+    printf("smoothness is %d\n", evaluator_smoothness(eval, board_get_bitboard(b)));
+    printf("empty is %.13f\n", evaluator_empty(eval, board_get_bitboard(b)));
+    printf("max value is %u\n", evaluator_max_value(eval, board_get_bitboard(b)));
+    printf("islands is %u\n", evaluator_islands(eval, board_get_bitboard(b)));
+    printf("value is %.13f\n", (double)evaluator_get_value(eval,
+      board_get_bitboard(b)) / EVALUATOR_ONE);
+
+    /* clear a few cells so there is somewhere to spawn */
+    bitboard base = board_get_bitboard(b) & 0xF0F00FF0FF00F0F0ULL;
+    int32 smoothness[BITBOARD_CELLS], islands[BITBOARD_CELLS];
+    uint32 spawn_mismatch = 0;
+    for (uint32 exp = 1; exp <= 2; exp++)
+    {
+      uint32 empty = evaluator_spawn_deltas(eval, base, exp, smoothness,
+        islands);
+      for (uint32 cell = 0; cell < BITBOARD_CELLS; cell++)
+      {
+        if ((empty & (1U << cell)) != 0)
+        {
+          bitboard spawned = bitboard_set_cell(base, cell, exp);
+          spawn_mismatch += smoothness[cell]
+            != evaluator_smoothness(eval, spawned)
+            - evaluator_smoothness(eval, base);
+          spawn_mismatch += islands[cell]
+            != (int32)(evaluator_islands(eval, spawned)
+            - evaluator_islands(eval, base));
+        }
+      }
+    }
+    printf("spawn delta mismatches is %u\n", spawn_mismatch);
+
+    /* a batch scores each board as it would alone */
+    bitboard leaves[37];
+    int32 values[ARRAY_SIZE(leaves)];
+    uint32 batch_mismatch = 0;
+    for (int i = 0; i < ARRAY_SIZE(leaves); i++)
+    {
+      leaves[i] = ((bitboard)rand() << 48) ^ ((bitboard)rand() << 24) ^ rand();
+    }
+    evaluator_get_values(eval, leaves, ARRAY_SIZE(leaves), values);
+    for (int i = 0; i < ARRAY_SIZE(leaves); i++)
+    {
+      batch_mismatch += values[i] != evaluator_get_value(eval, leaves[i]);
+    }
+    printf("evaluator batch mismatches is %u\n", batch_mismatch);
+
+    /* the second lookup hits, the weight change empties the cache */
+    uint64 hits = 0, misses = 0;
+    evaluator_reset_cache_stats(eval);
+    evaluator_get_value(eval, base);
+    evaluator_get_value(eval, base);
+    evaluator_set_empty_weight(eval, 1.0);
+    evaluator_get_value(eval, base);
+    evaluator_get_cache_stats(eval, &hits, &misses);
+    printf("cache hits is %llu, misses is %llu\n", (unsigned long long)hits,
+      (unsigned long long)misses);
 
     evaluator_destory(&eval);
     board_destory(&b);
   }
 
+  ntuple *trained = NULL, *loaded = NULL;
+  if (ntuple_create(&trained, NTUPLE_LAYOUT_SMALL))
+  {
+    uint32 mismatch = 0;
+    bitboard boards[3] = {0x0123456789ABCDEFULL, 0x1111222233334444ULL,
+      0x0000000100020003ULL};
+    ntuple_update(trained, boards[0], 100.0f);
+    ntuple_update(trained, boards[1], -40.0f);
+    if (ntuple_save(trained, "ntuple_test.weights")
+      && ntuple_load(&loaded, "ntuple_test.weights"))
+    {
+      for (int i = 0; i < ARRAY_SIZE(boards); i++)
+      {
+        mismatch += ntuple_get_estimate(trained, boards[i])
+          != ntuple_get_estimate(loaded, boards[i]);
+      }
+      printf("ntuple estimate is %.3f, reload mismatches is %u\n",
+        ntuple_get_estimate(loaded, boards[0]), mismatch);
+      int32 values[ARRAY_SIZE(boards)];
+      mismatch = 0;
+      ntuple_get_values(loaded, boards, ARRAY_SIZE(boards), values);
+      for (int i = 0; i < ARRAY_SIZE(boards); i++)
+      {
+        mismatch += values[i] != ntuple_get_value(loaded, boards[i]);
+      }
+      printf("ntuple batch mismatches is %u\n", mismatch);
+      ntuple_update(loaded, boards[1], -1e9f);
+      printf("ntuple values are %d and %d\n",
+        ntuple_get_value(loaded, boards[0]),
+        ntuple_get_value(loaded, boards[1]));
+      ntuple_destory(&loaded);
+    }
+    remove("ntuple_test.weights");
+
+    /* estimates far past the evaluator's range still stay apart */
+    float estimates[2];
+    int32 high[2];
+    for (int i = 0; i < ARRAY_SIZE(high); i++)
+    {
+      ntuple_update(trained, boards[0],
+        300000.0f + i * 10000.0f - ntuple_get_estimate(trained, boards[0]));
+      estimates[i] = ntuple_get_estimate(trained, boards[0]);
+      high[i] = ntuple_get_value(trained, boards[0]);
+    }
+    printf("ntuple estimates %.0f and %.0f are %d and %d\n", estimates[0],
+      estimates[1], high[0], high[1]);
+    ntuple_destory(&trained);
+  }
+
+  /* same slot for both boards: the deeper entry stays until it ages */
+  ttable *tt = NULL;
+  if (ttable_create(&tt, 1))
+  {
+    uint64 hits = 0, misses = 0, collisions = 0;
+    uint32 kept = 0;
+    bitboard b1 = 0x0123456789ABCDEFULL, b2 = 0x1111222233334444ULL;
+    ttable_probe(tt, 7, b1, PLAYER_TURN);
+    ttable_store(tt, 7, b1, PLAYER_TURN, 3, 42, TTABLE_EXACT, LEFT);
+    ttable_store(tt, 7, b2, PLAYER_TURN, 1, 5, TTABLE_LOWER, UP);
+    const ttable_entry *entry = ttable_probe(tt, 7, b1, PLAYER_TURN);
+    kept += entry != NULL && entry->value == 42 && entry->best == LEFT;
+    kept += ttable_probe(tt, 7, b2, PLAYER_TURN) == NULL;
+    ttable_new_generation(tt);
+    ttable_store(tt, 7, b2, PLAYER_TURN, 1, 5, TTABLE_LOWER, UP);
+    kept += ttable_probe(tt, 7, b2, PLAYER_TURN) != NULL;
+    ttable_get_stats(tt, &hits, &misses, &collisions);
+    printf("table kept %u, hits is %llu, misses is %llu, collisions is %llu\n",
+      kept, (unsigned long long)hits, (unsigned long long)misses,
+      (unsigned long long)collisions);
+    ttable_destory(&tt);
+  }
+
+  calculator *table = NULL, *sse = NULL;
+  if (calculator_create(&table) && calculator_create(&sse))
+  {
+    uint32 mismatch = 0;
+    bitboard bits = 0, n1 = 0, n2 = 0;
+    enum direction dir = UP;
+    calculator_set_kernel(table, CALCULATOR_KERNEL_TABLE);
+    if (calculator_set_kernel(sse, CALCULATOR_KERNEL_SSE))
+    {
+      srand(2048);
+      for (int i = 0; i < 100000; i++)
+      {
+        bits = ((bitboard)rand() << 48) ^ ((bitboard)rand() << 24) ^ rand();
+        for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+        {
+          mismatch += calculator_move(table, bits, &n1, dir)
+            != calculator_move(sse, bits, &n2, dir);
+          mismatch += (n1 != n2);
+        }
+      }
+      mismatch += calculator_get_score(table) != calculator_get_score(sse);
+      printf("sse kernel mismatches is %u\n", mismatch);
+    }
+
+    uint32 sym = 0;
+    mismatch = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+      bits = ((bitboard)rand() << 48) ^ ((bitboard)rand() << 24) ^ rand();
+      for (sym = 0; sym < BITBOARD_SYMMETRIES; sym++)
+      {
+        mismatch += bitboard_canonical(bits, NULL)
+          != bitboard_canonical(bitboard_apply_symmetry(bits, sym), NULL);
+        for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+        {
+          calculator_move(table, bits, &n1, dir);
+          calculator_move(table, bitboard_apply_symmetry(bits, sym), &n2,
+            bitboard_symmetry_direction(sym, dir));
+          mismatch += bitboard_apply_symmetry(n1, sym) != n2;
+          mismatch += bitboard_symmetry_direction_back(sym,
+            bitboard_symmetry_direction(sym, dir)) != dir;
+        }
+      }
+    }
+    printf("symmetry mismatches is %u\n", mismatch);
+
+    uint64 hash = 0;
+    mismatch = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+      bits = ((bitboard)rand() << 48) ^ ((bitboard)rand() << 24) ^ rand();
+      for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+      {
+        calculator_move_with_hash(table, bits, bitboard_hash(bits), &n1, &hash,
+          dir);
+        mismatch += hash != bitboard_hash(n1);
+      }
+    }
+    printf("hash mismatches is %u\n", mismatch);
+    uint64 score2 = calculator_get_score(sse);
+
+    bitboard in[67], out[67];
+    uint64 changed[2];
+    uint64 score = calculator_get_score(table);
+    mismatch = 0;
+    for (int i = 0; i < ARRAY_SIZE(in); i++)
+    {
+      in[i] = ((bitboard)rand() << 48) ^ ((bitboard)rand() << 24) ^ rand();
+    }
+    for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+    {
+      calculator_move_batch(sse, in, out, ARRAY_SIZE(in), dir, changed);
+      for (int i = 0; i < ARRAY_SIZE(in); i++)
+      {
+        mismatch += (calculator_move(table, in[i], &n1, dir) ? 1 : 0)
+          != ((changed[i / 64] >> (i % 64)) & 1);
+        mismatch += n1 != out[i];
+      }
+    }
+    mismatch += calculator_get_score(table) - score
+      != calculator_get_score(sse) - score2;
+    printf("batch mismatches is %u\n", mismatch);
+
+    /* 32768 32768 2 2: the 32768 pair cannot merge, the 2 pair does */
+    bits = 0x11FF;
+    score = calculator_get_score(table);
+    score2 = calculator_get_score(sse);
+    calculator_move(table, bits, &n1, LEFT);
+    calculator_move(sse, bits, &n2, LEFT);
+    printf("max tiles left are %llx and %llx, scored %llu and %llu\n",
+      (unsigned long long)n1, (unsigned long long)n2,
+      (unsigned long long)(calculator_get_score(table) - score),
+      (unsigned long long)(calculator_get_score(sse) - score2));
+    board *top = NULL;
+    if (board_create(&top, BITBOARD_ROWS, BITBOARD_COLS))
+    {
+      bits = 0xFF;
+      board_set_bitboard(top, bits);
+      printf("max tiles move left %u, board moves %x, calculator moves %x\n",
+        calculator_move(table, bits, &n1, LEFT), board_legal_moves(top),
+        calculator_legal_moves(table, bits));
+      board_destory(&top);
+    }
+
+    /* the mask agrees with the moves, 32768s included */
+    uint32 legal = 0;
+    mismatch = 0;
+    for (int i = 0; i < 100000; i++)
+    {
+      bits = ((bitboard)rand() << 48) ^ ((bitboard)rand() << 24) ^ rand();
+      bits |= (i % 4 == 0) ? 0xFF00FF00ULL : 0;
+      legal = calculator_legal_moves(table, bits);
+      for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+      {
+        mismatch += ((legal & CALCULATOR_MOVE_BIT(dir)) != 0)
+          != calculator_move(table, bits, &n1, dir);
+      }
+    }
+    printf("legal move mismatches is %u\n", mismatch);
+  }
+  calculator_destory(&sse);
+  calculator_destory(&table);
+
   return 0;
 }
@@ -0,0 +1,310 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * train.c
+ * Copyright (C) 2015 TangCheng <tangcheng2005@gmail.com>
+ *
+ * 2048 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * 2048 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+/*
+ * Trains n-tuple weights for the 4x4 ai by TD(0) on afterstates: every
+ * thread plays games greedily against the current weights and pulls the
+ * value of each afterstate towards the reward plus the value of the next
+ * one.  All threads update the same tables without locks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "models/calculator.h"
+#include "ai/ntuple.h"
+
+#define TRAIN_GAMES           100000
+#define TRAIN_CHECKPOINT      10000
+#define TRAIN_ALPHA           0.1
+#define TRAIN_OUTPUT          "2048.weights"
+#define TRAIN_MAX_THREADS     256
+#define TRAIN_GOAL_EXPONENT   11        /* 2048 */
+
+typedef struct _trainer
+{
+	ntuple            *nt;
+	const char        *output;
+	float             alpha;
+	uint64            games;
+	uint64            checkpoint;
+	uint64            seed;
+	uint64            started;
+	uint64            finished;
+	uint64            window;           /* games since the last report */
+	uint64            score_sum;
+	uint64            goal_count;
+	pthread_mutex_t   save_lock;
+} trainer;
+
+typedef struct _train_thread
+{
+	trainer           *t;
+	pthread_t         id;
+	uint64            rng;
+} train_thread;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-l small|large] [-g games] [-t threads]"
+		" [-a alpha] [-c checkpoint] [-i weights] [-o weights] [-s seed]\n",
+		name);
+	fprintf(stderr, "  defaults: small layout, %u games, one thread per core,"
+		" alpha %.2f,\n  a checkpoint every %u games to %s\n",
+		TRAIN_GAMES, TRAIN_ALPHA, TRAIN_CHECKPOINT, TRAIN_OUTPUT);
+	fprintf(stderr, "  -i resumes from a weights file instead of zeros\n");
+}
+
+static uint32 train_max_exponent(bitboard b)
+{
+	uint32 max = 0;
+	uint32 cell = 0;
+
+	for (cell = 0; cell < BITBOARD_CELLS; cell++)
+	{
+		if ((b & BITBOARD_CELL_MASK) > max)
+		{
+			max = (uint32)(b & BITBOARD_CELL_MASK);
+		}
+		b >>= BITBOARD_CELL_BITS;
+	}
+
+	return max;
+}
+
+/* one game; returns its score and leaves the final board in *last */
+static uint64 train_play(trainer *self, calculator *calc, uint64 *rng,
+	bitboard *last)
+{
+	bitboard b = bitboard_spawn(bitboard_spawn(0, rng), rng);
+	bitboard after = 0, best_after = 0, prev = 0;
+	enum direction dir = UP;
+	bool found = false, has_prev = false;
+	uint64 before = 0, reward = 0, best_reward = 0, total = 0;
+	float value = 0, best_value = 0;
+
+	for (;;)
+	{
+		found = false;
+		for (dir = UP; dir < BOTTOM_OF_DIRECTION; dir++)
+		{
+			before = calculator_get_score(calc);
+			if (calculator_move(calc, b, &after, dir) == true)
+			{
+				reward = calculator_get_score(calc) - before;
+				value = (float)reward + ntuple_get_estimate(self->nt, after);
+				if (found == false || value > best_value)
+				{
+					found = true;
+					best_value = value;
+					best_after = after;
+					best_reward = reward;
+				}
+			}
+		}
+		if (found == false)
+		{
+			break;
+		}
+
+		if (has_prev == true)
+		{
+			ntuple_update(self->nt, prev, self->alpha
+				* (best_value - ntuple_get_estimate(self->nt, prev)));
+		}
+		prev = best_after;
+		has_prev = true;
+		total += best_reward;
+		b = bitboard_spawn(best_after, rng);
+	}
+
+	/* nothing follows the last afterstate */
+	if (has_prev == true)
+	{
+		ntuple_update(self->nt, prev,
+			-self->alpha * ntuple_get_estimate(self->nt, prev));
+	}
+	*last = b;
+
+	return total;
+}
+
+static void train_checkpoint(trainer *self, uint64 finished, bool wait)
+{
+	uint64 window = 0, score_sum = 0, goal_count = 0;
+
+	if (wait == true)
+	{
+		pthread_mutex_lock(&self->save_lock);
+	}
+	else if (pthread_mutex_trylock(&self->save_lock) != 0)
+	{
+		return;
+	}
+
+	window = __sync_fetch_and_and(&self->window, 0);
+	score_sum = __sync_fetch_and_and(&self->score_sum, 0);
+	goal_count = __sync_fetch_and_and(&self->goal_count, 0);
+	if (window != 0)
+	{
+		fprintf(stderr, "games %llu, mean score %.0f, reached 2048 %.1f%%\n",
+			(unsigned long long)finished, (double)score_sum / window,
+			100.0 * goal_count / window);
+	}
+	if (ntuple_save(self->nt, self->output) == false)
+	{
+		fprintf(stderr, "could not save weights to %s\n", self->output);
+	}
+	pthread_mutex_unlock(&self->save_lock);
+}
+
+static void *train_worker(void *arg)
+{
+	train_thread *thread = (train_thread *)arg;
+	trainer *self = thread->t;
+	calculator *calc = NULL;
+	bitboard last = 0;
+	uint64 score = 0, finished = 0;
+
+	if (calculator_create(&calc) == false)
+	{
+		return NULL;
+	}
+
+	while (__sync_fetch_and_add(&self->started, 1) < self->games)
+	{
+		score = train_play(self, calc, &thread->rng, &last);
+		__sync_fetch_and_add(&self->score_sum, score);
+		__sync_fetch_and_add(&self->window, 1);
+		if (train_max_exponent(last) >= TRAIN_GOAL_EXPONENT)
+		{
+			__sync_fetch_and_add(&self->goal_count, 1);
+		}
+		finished = __sync_add_and_fetch(&self->finished, 1);
+		if (finished % self->checkpoint == 0)
+		{
+			train_checkpoint(self, finished, false);
+		}
+	}
+	calculator_destory(&calc);
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	trainer t;
+	train_thread threads[TRAIN_MAX_THREADS];
+	enum ntuple_layout layout = NTUPLE_LAYOUT_SMALL;
+	const char *input = NULL;
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	long i = 0;
+	int opt = 0;
+
+	memset(&t, 0, sizeof(t));
+	t.output = TRAIN_OUTPUT;
+	t.alpha = TRAIN_ALPHA;
+	t.games = TRAIN_GAMES;
+	t.checkpoint = TRAIN_CHECKPOINT;
+	t.seed = 2048;
+
+	while ((opt = getopt(argc, argv, "l:g:t:a:c:i:o:s:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l':
+				if (strcmp(optarg, "small") == 0)
+				{
+					layout = NTUPLE_LAYOUT_SMALL;
+				}
+				else if (strcmp(optarg, "large") == 0)
+				{
+					layout = NTUPLE_LAYOUT_LARGE;
+				}
+				else
+				{
+					usage(argv[0]);
+					return (1);
+				}
+				break;
+			case 'g':
+				t.games = strtoull(optarg, NULL, 10);
+				break;
+			case 't':
+				count = atol(optarg);
+				break;
+			case 'a':
+				t.alpha = (float)atof(optarg);
+				break;
+			case 'c':
+				t.checkpoint = strtoull(optarg, NULL, 10);
+				break;
+			case 'i':
+				input = optarg;
+				break;
+			case 'o':
+				t.output = optarg;
+				break;
+			case 's':
+				t.seed = strtoull(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return (1);
+		}
+	}
+	if (count < 1 || count > TRAIN_MAX_THREADS || t.checkpoint == 0)
+	{
+		usage(argv[0]);
+		return (1);
+	}
+
+	if ((input != NULL && ntuple_load(&t.nt, input) == false)
+		|| (input == NULL && ntuple_create(&t.nt, layout) == false))
+	{
+		fprintf(stderr, "could not set up the weights\n");
+		return (1);
+	}
+	pthread_mutex_init(&t.save_lock, NULL);
+
+	for (i = 0; i < count; i++)
+	{
+		threads[i].t = &t;
+		threads[i].rng = (t.seed + (uint64)i + 1) * 0x9E3779B97F4A7C15ULL;
+		if (pthread_create(&threads[i].id, NULL, train_worker, &threads[i]) != 0)
+		{
+			count = i;
+			break;
+		}
+	}
+	for (i = 0; i < count; i++)
+	{
+		pthread_join(threads[i].id, NULL);
+	}
+
+	/* a periodic checkpoint may have been skipped, the last one never is */
+	train_checkpoint(&t, t.finished, true);
+	pthread_mutex_destroy(&t.save_lock);
+	ntuple_destory(&t.nt);
+
+	return (0);
+}
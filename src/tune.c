@@ -0,0 +1,321 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * tune.c
+ * Copyright (C) 2015 TangCheng <tangcheng2005@gmail.com>
+ *
+ * 2048 is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * 2048 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.";
+ */
+
+/*
+ * Tunes the heuristic evaluator weights by coordinate descent: every
+ * weight in turn is scaled up and down by a step, a change is kept when
+ * the mean score of a batch of games improves, and the step is halved
+ * after a round without any.  Every candidate plays the same seeded
+ * games, so differences come from the weights and not from the spawns.
+ * The games of a batch are spread over forked workers, as the search
+ * keeps its boards in a per process pool.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "models/calculator.h"
+#include "ai/minmax.h"
+
+#define TUNE_GAMES            64
+#define TUNE_ROUNDS           8
+#define TUNE_DEPTH            3
+#define TUNE_STEP             0.5
+#define TUNE_OUTPUT           "2048.evaluator"
+#define TUNE_MAX_WORKERS      256
+#define TUNE_WEIGHTS          4
+
+typedef struct _tuner
+{
+	uint32            depth;
+	uint64            games;
+	uint64            seed;
+	long              workers;
+} tuner;
+
+static const char *tune_names[TUNE_WEIGHTS] =
+{
+	"smoothness", "monotonicity", "empty", "max value"
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-d depth] [-g games] [-r rounds] [-t workers]"
+		" [-i weights] [-o weights] [-s seed]\n", name);
+	fprintf(stderr, "  defaults: depth %u, %u games per candidate, %u rounds,"
+		" one worker per core,\n  best weights written to %s\n",
+		TUNE_DEPTH, TUNE_GAMES, TUNE_ROUNDS, TUNE_OUTPUT);
+	fprintf(stderr, "  weights files hold the smoothness, monotonicity, empty"
+		" and max value weights\n");
+}
+
+/* one game of the search against seeded spawns; returns its score */
+static uint64 tune_play(tuner *self, minmax *m, calculator *calc, uint64 game)
+{
+	uint64 rng = (self->seed + game + 1) * 0x9E3779B97F4A7C15ULL;
+	uint64 start = calculator_get_score(calc);
+	bitboard b = bitboard_spawn(bitboard_spawn(0, &rng), &rng);
+	bitboard after = 0;
+	enum direction dir = UP;
+
+	for (;;)
+	{
+		dir = minmax_search(m, b, self->depth);
+		if (dir == BOTTOM_OF_DIRECTION
+			|| calculator_move(calc, b, &after, dir) == false)
+		{
+			break;
+		}
+		b = bitboard_spawn(after, &rng);
+	}
+
+	return calculator_get_score(calc) - start;
+}
+
+/* games worker, worker + workers, ... of the batch; the sum goes to fd */
+static void tune_worker(tuner *self, const float *weights, long worker, int fd)
+{
+	minmax *m = NULL;
+	calculator *calc = NULL;
+	uint64 sum = 0, game = 0;
+
+	if (minmax_create(&m) == true && calculator_create(&calc) == true)
+	{
+		minmax_set_weights(m, weights[0], weights[1], weights[2], weights[3]);
+		for (game = (uint64)worker; game < self->games;
+			game += (uint64)self->workers)
+		{
+			sum += tune_play(self, m, calc, game);
+		}
+		if (write(fd, &sum, sizeof(sum)) != sizeof(sum))
+		{
+			_exit(1);
+		}
+	}
+	calculator_destory(&calc);
+	minmax_destory(&m);
+	_exit(0);
+}
+
+/* the mean score of the batch, negative when a worker went missing */
+static double tune_score(tuner *self, const float *weights)
+{
+	int fds[TUNE_MAX_WORKERS];
+	int p[2];
+	pid_t pid = 0;
+	uint64 sum = 0, part = 0;
+	bool ok = true;
+	long i = 0, started = 0;
+
+	fflush(NULL);
+	for (i = 0; i < self->workers; i++)
+	{
+		if (pipe(p) != 0)
+		{
+			ok = false;
+			break;
+		}
+		pid = fork();
+		if (pid == 0)
+		{
+			close(p[0]);
+			tune_worker(self, weights, i, p[1]);
+		}
+		close(p[1]);
+		if (pid < 0)
+		{
+			close(p[0]);
+			ok = false;
+			break;
+		}
+		fds[started++] = p[0];
+	}
+
+	for (i = 0; i < started; i++)
+	{
+		if (read(fds[i], &part, sizeof(part)) == sizeof(part))
+		{
+			sum += part;
+		}
+		else
+		{
+			ok = false;
+		}
+		close(fds[i]);
+	}
+	while (wait(NULL) > 0)
+	{
+	}
+
+	return (ok == true) ? (double)sum / self->games : -1;
+}
+
+static bool tune_save(const float *weights, const char *path)
+{
+	bool ret = false;
+	FILE *fp = fopen(path, "w");
+
+	if (fp != NULL)
+	{
+		ret = (fprintf(fp, "%g %g %g %g\n", weights[0], weights[1], weights[2],
+			weights[3]) > 0) ? true : false;
+		ret &= (fclose(fp) == 0) ? true : false;
+	}
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	tuner t;
+	float best[TUNE_WEIGHTS], candidate[TUNE_WEIGHTS];
+	const char *input = NULL;
+	const char *output = TUNE_OUTPUT;
+	FILE *fp = NULL;
+	double score = 0, best_score = 0, step = TUNE_STEP, factor = 0;
+	uint32 rounds = TUNE_ROUNDS, round = 0, i = 0, sign = 0;
+	bool improved = false;
+	int opt = 0;
+
+	memset(&t, 0, sizeof(t));
+	t.depth = TUNE_DEPTH;
+	t.games = TUNE_GAMES;
+	t.seed = 2048;
+	t.workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "d:g:r:t:i:o:s:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				t.depth = (uint32)atoi(optarg);
+				break;
+			case 'g':
+				t.games = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				rounds = (uint32)atoi(optarg);
+				break;
+			case 't':
+				t.workers = atol(optarg);
+				break;
+			case 'i':
+				input = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 's':
+				t.seed = strtoull(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return (1);
+		}
+	}
+	if (t.workers < 1 || t.workers > TUNE_MAX_WORKERS || t.games == 0
+		|| t.depth < 2 || t.depth > MAX_SEARCH_DEPTH)
+	{
+		usage(argv[0]);
+		return (1);
+	}
+
+	/* the evaluator defaults unless a weights file is given */
+	best[0] = 0.1f;
+	best[1] = 1.0f;
+	best[2] = 2.7f;
+	best[3] = 1.0f;
+	if (input != NULL)
+	{
+		fp = fopen(input, "r");
+		if (fp == NULL || fscanf(fp, "%f %f %f %f", &best[0], &best[1],
+			&best[2], &best[3]) != 4)
+		{
+			fprintf(stderr, "could not load weights from %s\n", input);
+			if (fp != NULL)
+			{
+				fclose(fp);
+			}
+			return (1);
+		}
+		fclose(fp);
+	}
+
+	best_score = tune_score(&t, best);
+	if (best_score < 0)
+	{
+		fprintf(stderr, "could not play the games\n");
+		return (1);
+	}
+	fprintf(stderr, "start: %g %g %g %g, mean score %.0f\n", best[0], best[1],
+		best[2], best[3], best_score);
+
+	for (round = 0; round < rounds; round++)
+	{
+		improved = false;
+		factor = 1 + step;
+		for (i = 0; i < TUNE_WEIGHTS; i++)
+		{
+			for (sign = 0; sign < 2; sign++)
+			{
+				memcpy(candidate, best, sizeof(best));
+				if (candidate[i] == 0)
+				{
+					candidate[i] = (float)((sign == 0) ? step : -step);
+				}
+				else
+				{
+					candidate[i] = (float)((sign == 0) ? candidate[i] * factor
+						: candidate[i] / factor);
+				}
+				score = tune_score(&t, candidate);
+				if (score > best_score)
+				{
+					memcpy(best, candidate, sizeof(best));
+					best_score = score;
+					improved = true;
+					fprintf(stderr, "round %u: %s %g, mean score %.0f\n", round + 1,
+						tune_names[i], best[i], best_score);
+					if (tune_save(best, output) == false)
+					{
+						fprintf(stderr, "could not save weights to %s\n", output);
+					}
+					break;
+				}
+			}
+		}
+		if (improved == false)
+		{
+			step /= 2;
+			fprintf(stderr, "round %u: no change, step %g\n", round + 1, step);
+		}
+	}
+
+	if (tune_save(best, output) == false)
+	{
+		fprintf(stderr, "could not save weights to %s\n", output);
+		return (1);
+	}
+	printf("%g %g %g %g\n", best[0], best[1], best[2], best[3]);
+
+	return (0);
+}